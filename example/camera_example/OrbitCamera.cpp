@@ -10,7 +10,7 @@ void OrbitCamera::CalcView(int w, int h, int x, int y) {
   auto q_pitch = falg::QuaternionAxisAngle({1, 0, 0}, pitchRadians);
   auto transform =
       origin * falg::Transform{shift, falg::QuaternionMul(q_yaw, q_pitch)};
-  state.view = transform.RowMatrix();
+  state.view = falg::Affine(transform).RowMatrix();
 
   // inverse view transform
   auto inv = transform.Inverse();
@@ -18,6 +18,7 @@ void OrbitCamera::CalcView(int w, int h, int x, int y) {
     state.rotation = inv.rotation;
     state.position = inv.translation;
   }
+  falg::Affine toWorld(inv);
 
   // ray for mouse cursor
   auto t = std::tan(state.fovYRadians / 2);
@@ -28,7 +29,7 @@ void OrbitCamera::CalcView(int w, int h, int x, int y) {
       t * yy,
       -1,
   };
-  state.ray_direction = inv.ApplyDirection(dir);
+  state.ray_direction = toWorld.ApplyDirection(dir);
   state.ray_origin = state.position;
 }
 
@@ -0,0 +1,44 @@
+#pragma once
+// GizmoSystem::OutputStream into a dynamic Model
+#include "renderer.h"
+#include <gizmesh.h>
+
+// end() writes the gizmo geometry into the mapped buffers of the Model,
+// without a copy in between. unmap() after end()
+class ModelStream : public gizmesh::GizmoSystem::OutputStream {
+  Model *m_model;
+  void *m_device;
+  uint8_t *m_vertices = nullptr;
+  uint8_t *m_indices = nullptr;
+  bool m_mapped = false;
+
+public:
+  ModelStream(Model *model, void *device) : m_model(model), m_device(device) {}
+  ~ModelStream() { unmap(); }
+
+  bool reserve(uint32_t verticesBytes, uint32_t vertexStride,
+               uint32_t indicesBytes, uint32_t indexStride) override {
+    void *vertices = nullptr;
+    void *indices = nullptr;
+    m_mapped = m_model->mapMesh(m_device, verticesBytes, vertexStride,
+                                indicesBytes, indexStride, &vertices, &indices);
+    m_vertices = static_cast<uint8_t *>(vertices);
+    m_indices = static_cast<uint8_t *>(indices);
+    return m_mapped;
+  }
+
+  uint8_t *vertices(uint32_t offset, uint32_t) override {
+    return m_vertices + offset;
+  }
+
+  uint8_t *indices(uint32_t offset, uint32_t) override {
+    return m_indices + offset;
+  }
+
+  void unmap() {
+    if (m_mapped) {
+      m_model->unmapMesh(m_device);
+      m_mapped = false;
+    }
+  }
+};
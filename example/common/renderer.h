@@ -12,6 +12,12 @@ public:
   void uploadMesh(void *device, const void *vertices, uint32_t verticesSize,
                   uint32_t vertexStride, const void *indices,
                   uint32_t indicesSize, uint32_t indexSize, bool is_dynamic);
+  // the dynamic mesh is written in place until unmapMesh. false if it does
+  // not fit
+  bool mapMesh(void *device, uint32_t verticesSize, uint32_t vertexStride,
+               uint32_t indicesSize, uint32_t indexSize, void **vertices,
+               void **indices);
+  void unmapMesh(void *device);
   void draw(void *context, const float *model, const float *vp,
             const float *eye);
 };
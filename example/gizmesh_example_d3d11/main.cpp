@@ -1,5 +1,6 @@
 ﻿#include "OrbitCamera.h"
 #include "Win32Window.h"
+#include "model_stream.h"
 #include "renderer.h"
 #include "shader.h"
 #include "teapot.h"
@@ -254,10 +255,15 @@ int main(int argc, char *argv[]) {
     // update camera
     camera.Update(state);
 
+    auto viewProjection = camera.state.view * camera.state.projection;
+
     // gizmo new frame
     system.begin(camera.state.position, camera.state.rotation,
                  camera.state.ray_origin, camera.state.ray_direction,
-                 state.MouseLeftDown());
+                 state.MouseLeftDown(),
+                 {camera.state.fovYRadians,
+                  static_cast<float>(camera.state.viewportHeight),
+                  viewProjection});
 
     if (state.KeyCode['R']) {
       mode = transform_mode::rotate;
@@ -273,8 +279,6 @@ int main(int argc, char *argv[]) {
     }
     lastState = state.KeyCode;
 
-    auto viewProjection = camera.state.view * camera.state.projection;
-
     //
     // draw
     //
@@ -318,10 +322,10 @@ int main(int argc, char *argv[]) {
         break;
       }
 
-      auto buffer = system.end();
-      gizmo_mesh->uploadMesh(device, buffer.pVertices, buffer.verticesBytes,
-                             buffer.vertexStride, buffer.pIndices,
-                             buffer.indicesBytes, buffer.indexStride, true);
+      // written into the mapped buffers of gizmo_mesh
+      ModelStream stream(gizmo_mesh.get(), device);
+      system.end(stream);
+      stream.unmap();
     }
 
     //
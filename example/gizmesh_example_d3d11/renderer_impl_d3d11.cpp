@@ -115,41 +115,29 @@ class ModelImpl {
   DXGI_FORMAT m_indexFormat = DXGI_FORMAT_R32_UINT;
   int m_indexCount = 0;
 
-public:
-  void upload_dynamic_mesh(ID3D11Device *device, const uint8_t *pVertices,
-                           uint32_t verticesBytes, uint32_t vertexStride,
-                           const uint8_t *pIndices, uint32_t indicesBytes,
-                           uint32_t indexStride) {
-    ComPtr<ID3D11DeviceContext> context;
-    device->GetImmediateContext(&context);
+  static const uint32_t max_dynamic_vertices = 65535;
 
+  // the shader and buffers of a dynamic mesh
+  bool prepare_dynamic_mesh(ID3D11Device *device, uint32_t indexStride) {
     if (!m_shader) {
       m_shader.reset(new Shader);
       if (!m_shader->initialize(
               device, SourceWithEntryPoint{gizmo_shader, "vsMain", sizeof(ConstantBuffer)},
               std::nullopt, SourceWithEntryPoint{gizmo_shader, "psMain"})) {
-        return;
+        return false;
       }
     }
     if (!m_vb) {
       D3D11_BUFFER_DESC desc{0};
-      desc.ByteWidth = sizeof(Vertex) * 65535;
+      desc.ByteWidth = sizeof(Vertex) * max_dynamic_vertices;
       desc.Usage = D3D11_USAGE_DYNAMIC;
       desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
       desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
       if (FAILED(device->CreateBuffer(&desc, nullptr, &m_vb))) {
-        return;
+        return false;
       }
     }
-    {
-      D3D11_MAPPED_SUBRESOURCE mapped;
-      context->Map(m_vb.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-      memcpy(mapped.pData, pVertices, verticesBytes);
-      context->Unmap(m_vb.Get(), 0);
-    }
-
-    m_indexCount = indicesBytes / indexStride;
     if (!m_ib) {
       switch (indexStride) {
       case 4:
@@ -162,21 +150,70 @@ public:
         throw;
       }
       D3D11_BUFFER_DESC desc = {0};
-      desc.ByteWidth = indexStride * 65535;
+      desc.ByteWidth = indexStride * max_dynamic_vertices;
       desc.Usage = D3D11_USAGE_DYNAMIC;
       desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
       desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
       if (FAILED(device->CreateBuffer(&desc, nullptr, &m_ib))) {
-        return;
+        return false;
       }
     }
-    {
-      D3D11_MAPPED_SUBRESOURCE mapped;
-      context->Map(m_ib.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-      memcpy(mapped.pData, pIndices, indicesBytes);
-      context->Unmap(m_ib.Get(), 0);
+    return true;
+  }
+
+public:
+  void upload_dynamic_mesh(ID3D11Device *device, const uint8_t *pVertices,
+                           uint32_t verticesBytes, uint32_t vertexStride,
+                           const uint8_t *pIndices, uint32_t indicesBytes,
+                           uint32_t indexStride) {
+    void *vertices;
+    void *indices;
+    if (!map_dynamic_mesh(device, verticesBytes, vertexStride, indicesBytes,
+                          indexStride, &vertices, &indices)) {
+      return;
+    }
+    memcpy(vertices, pVertices, verticesBytes);
+    memcpy(indices, pIndices, indicesBytes);
+    unmap_dynamic_mesh(device);
+  }
+
+  // the buffers are discarded and written in place until unmap_dynamic_mesh
+  bool map_dynamic_mesh(ID3D11Device *device, uint32_t verticesBytes,
+                        uint32_t vertexStride, uint32_t indicesBytes,
+                        uint32_t indexStride, void **pVertices,
+                        void **pIndices) {
+    if (!prepare_dynamic_mesh(device, indexStride)) {
+      return false;
+    }
+    if (verticesBytes > sizeof(Vertex) * max_dynamic_vertices ||
+        indicesBytes > indexStride * max_dynamic_vertices) {
+      return false;
+    }
+    ComPtr<ID3D11DeviceContext> context;
+    device->GetImmediateContext(&context);
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(context->Map(m_vb.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0,
+                            &mapped))) {
+      return false;
+    }
+    *pVertices = mapped.pData;
+    if (FAILED(context->Map(m_ib.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0,
+                            &mapped))) {
+      context->Unmap(m_vb.Get(), 0);
+      return false;
     }
+    *pIndices = mapped.pData;
+    m_indexCount = indicesBytes / indexStride;
+    return true;
+  }
+
+  void unmap_dynamic_mesh(ID3D11Device *device) {
+    ComPtr<ID3D11DeviceContext> context;
+    device->GetImmediateContext(&context);
+    context->Unmap(m_vb.Get(), 0);
+    context->Unmap(m_ib.Get(), 0);
   }
 
   void upload_static_mesh(ID3D11Device *device, const uint8_t *pVertices,
@@ -275,6 +312,18 @@ void Model::uploadMesh(void *device, const void *vertices,
   }
 }
 
+bool Model::mapMesh(void *device, uint32_t verticesSize,
+                    uint32_t vertexStride, uint32_t indicesSize,
+                    uint32_t indexSize, void **vertices, void **indices) {
+  return m_impl->map_dynamic_mesh((ID3D11Device *)device, verticesSize,
+                                  vertexStride, indicesSize, indexSize,
+                                  vertices, indices);
+}
+
+void Model::unmapMesh(void *device) {
+  m_impl->unmap_dynamic_mesh((ID3D11Device *)device);
+}
+
 void Model::draw(void *context, const float *model, const float *vp,
                  const float *eye) {
   m_impl->draw((ID3D11DeviceContext *)context, *(std::array<float, 3> *)eye,
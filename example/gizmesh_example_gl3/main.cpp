@@ -1,6 +1,7 @@
 ﻿// This is free and unencumbered software released into the public domain.
 // For more information, please refer to <http://unlicense.org>
 
+#include "model_stream.h"
 #include "renderer.h"
 #include "teapot.h"
 #include <OrbitCamera.h>
@@ -83,10 +84,15 @@ int main(int argc, char *argv[]) {
     // update camera
     camera.Update(state);
 
+    auto viewProjection = camera.state.view * camera.state.projection;
+
     // gizmo new frame
     gizmo_system.begin(camera.state.position, camera.state.rotation,
                        camera.state.ray_origin, camera.state.ray_direction,
-                       state.MouseLeftDown());
+                       state.MouseLeftDown(),
+                       {camera.state.fovYRadians,
+                        static_cast<float>(camera.state.viewportHeight),
+                        viewProjection});
 
     if (state.KeyCode['R']) {
       mode = transform_mode::rotate;
@@ -102,8 +108,6 @@ int main(int argc, char *argv[]) {
     }
     lastState = state.KeyCode;
 
-    auto viewProjection = camera.state.view * camera.state.projection;
-
     //
     // draw
     //
@@ -147,10 +151,10 @@ int main(int argc, char *argv[]) {
         break;
       }
 
-      auto buffer = gizmo_system.end();
-      gizmo_mesh->uploadMesh(device, buffer.pVertices, buffer.verticesBytes,
-                             buffer.vertexStride, buffer.pIndices,
-                             buffer.indicesBytes, buffer.indexStride, true);
+      // written into the mapped buffers of gizmo_mesh
+      ModelStream stream(gizmo_mesh.get(), device);
+      gizmo_system.end(stream);
+      stream.unmap();
     }
 
     renderer.clearDepth();
@@ -86,6 +86,8 @@ constexpr const char lit_frag[] = R"(#version 330
 class ModelImpl {
   std::unique_ptr<GlShader> m_shader;
   GlMesh m_mesh;
+  bool m_mappedVertices = false;
+  bool m_mappedIndices = false;
 
 public:
   void upload_mesh(const void *pVertices, uint32_t verticesBytes,
@@ -122,6 +124,43 @@ public:
                           isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
   }
 
+  // the buffers are orphaned and written in place until unmap_mesh. an empty
+  // buffer is not mapped
+  bool map_mesh(uint32_t verticesBytes, uint32_t vertexStride,
+                uint32_t indicesBytes, uint32_t indexStride, void **pVertices,
+                void **pIndices) {
+    upload_mesh(nullptr, verticesBytes, vertexStride, nullptr, indicesBytes,
+                indexStride, true);
+    const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    *pVertices = verticesBytes
+                     ? glMapNamedBufferRangeEXT(m_mesh.get_vertex_data_buffer(),
+                                                0, verticesBytes, access)
+                     : nullptr;
+    *pIndices = indicesBytes
+                    ? glMapNamedBufferRangeEXT(m_mesh.get_index_data_buffer(),
+                                               0, indicesBytes, access)
+                    : nullptr;
+    m_mappedVertices = *pVertices != nullptr;
+    m_mappedIndices = *pIndices != nullptr;
+    if ((verticesBytes && !m_mappedVertices) ||
+        (indicesBytes && !m_mappedIndices)) {
+      unmap_mesh();
+      return false;
+    }
+    return true;
+  }
+
+  void unmap_mesh() {
+    if (m_mappedVertices) {
+      glUnmapNamedBufferEXT(m_mesh.get_vertex_data_buffer());
+      m_mappedVertices = false;
+    }
+    if (m_mappedIndices) {
+      glUnmapNamedBufferEXT(m_mesh.get_index_data_buffer());
+      m_mappedIndices = false;
+    }
+  }
+
   void draw(const float *eye, const float *viewProj, const float *model,
             bool isGizmo = false) {
     if (isGizmo) {
@@ -148,6 +187,15 @@ void Model::uploadMesh(void *, const void *vertices, uint32_t verticesSize,
                       indicesSize, indexSize, is_dynamic);
 }
 
+bool Model::mapMesh(void *, uint32_t verticesSize, uint32_t vertexStride,
+                    uint32_t indicesSize, uint32_t indexSize, void **vertices,
+                    void **indices) {
+  return m_impl->map_mesh(verticesSize, vertexStride, indicesSize, indexSize,
+                          vertices, indices);
+}
+
+void Model::unmapMesh(void *) { m_impl->unmap_mesh(); }
+
 void Model::draw(void *, const float *model, const float *vp,
                  const float *eye) {
   m_impl->draw(eye, vp, model);
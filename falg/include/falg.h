@@ -7,6 +7,16 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+// floats per instruction of the SIMD kernels, see simd
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FALG_SIMD 8
+#elif defined(__SSE2__) || defined(_M_X64) ||                                 \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FALG_SIMD 4
+#endif
+
 ///
 /// float algebra
 ///
@@ -534,6 +544,110 @@ struct TRS {
 };
 static_assert(sizeof(TRS) == 40, "TRS");
 
+// Transform or TRS prepared for applying to many points: the rotation
+// (and scale) as row vectors and the translation, a 3x4 row matrix.
+// Applying it is the same arithmetic as Transform::ApplyPosition without the
+// quaternion to basis conversion.
+struct Affine {
+  float3 x{1, 0, 0};
+  float3 y{0, 1, 0};
+  float3 z{0, 0, 1};
+  float3 t{0, 0, 0};
+
+  Affine() = default;
+
+  Affine(const float3 &x, const float3 &y, const float3 &z, const float3 &t)
+      : x(x), y(y), z(z), t(t) {}
+
+  explicit Affine(const Transform &transform)
+      : x(QuaternionXDir(transform.rotation)),
+        y(QuaternionYDir(transform.rotation)),
+        z(QuaternionZDir(transform.rotation)), t(transform.translation) {}
+
+  explicit Affine(const TRS &trs)
+      : x(MulScalar(QuaternionXDir(trs.rotation), trs.scale[0])),
+        y(MulScalar(QuaternionYDir(trs.rotation), trs.scale[1])),
+        z(MulScalar(QuaternionZDir(trs.rotation), trs.scale[2])),
+        t(trs.translation) {}
+
+  std::array<float, 16> RowMatrix() const {
+    return {x[0], x[1], x[2], 0, y[0], y[1], y[2], 0,
+            z[0], z[1], z[2], 0, t[0], t[1], t[2], 1};
+  }
+
+  float3 ApplyDirection(const float3 &v) const {
+    return Add(MulScalar(x, v[0]), Add(MulScalar(y, v[1]), MulScalar(z, v[2])));
+  }
+
+  float3 ApplyPosition(const float3 &v) const {
+    return Add(ApplyDirection(v), t);
+  }
+
+  // general 3x3 inverse. identity if singular
+  Affine Inverse() const {
+    auto c0 = Cross(y, z);
+    auto c1 = Cross(z, x);
+    auto c2 = Cross(x, y);
+    auto det = Dot(x, c0);
+    if (det == 0) {
+      return {};
+    }
+    auto inv = 1 / det;
+    // rows of the inverse are the columns of the adjugate
+    Affine a({c0[0] * inv, c1[0] * inv, c2[0] * inv},
+             {c0[1] * inv, c1[1] * inv, c2[1] * inv},
+             {c0[2] * inv, c1[2] * inv, c2[2] * inv}, {0, 0, 0});
+    a.t = MulScalar(a.ApplyDirection(t), -1);
+    return a;
+  }
+};
+
+// Transform with an identity rotation. A position is one add and a
+// direction is unchanged
+struct Translation {
+  float3 t{0, 0, 0};
+
+  std::array<float, 16> RowMatrix() const {
+    return {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, t[0], t[1], t[2], 1};
+  }
+
+  float3 ApplyDirection(const float3 &v) const { return v; }
+
+  float3 ApplyPosition(const float3 &v) const { return Add(v, t); }
+
+  Translation Inverse() const { return {MulScalar(t, -1)}; }
+};
+
+inline bool QuaternionIsIdentity(const float4 &q) {
+  return q[0] == 0 && q[1] == 0 && q[2] == 0 && q[3] == 1;
+}
+
+// f(Translation) for an identity rotation, else f(Affine).
+// f is a template, so each kind of transform gets its own compiled path
+template <typename F> auto DispatchTransform(const Transform &t, F &&f) {
+  if (QuaternionIsIdentity(t.rotation)) {
+    return f(Translation{t.translation});
+  }
+  return f(Affine(t));
+}
+
+// T is Affine, Translation or Transform
+template <typename T>
+void ApplyPositions(const T &transform, const float3 *src, size_t count,
+                    float3 *dst) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = transform.ApplyPosition(src[i]);
+  }
+}
+
+template <typename T>
+void ApplyDirections(const T &transform, const float3 *src, size_t count,
+                     float3 *dst) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = transform.ApplyDirection(src[i]);
+  }
+}
+
 template <typename T> std::array<float, 4> RowMatrixToQuaternion(const T &m);
 
 template <typename T> TRS RowMatrixDecompose(const T &_m) {
@@ -567,7 +681,8 @@ struct Ray {
 
   float3 SetT(float t) const { return Add(origin, MulScalar(direction, t)); }
 
-  Ray Transform(const falg::Transform &t) const {
+  // T is falg::Transform, Affine or Translation
+  template <typename T> Ray Transform(const T &t) const {
     return {
         t.ApplyPosition(origin),
         t.ApplyDirection(direction),
@@ -575,6 +690,25 @@ struct Ray {
   }
 };
 
+// A ray with the reciprocal of its direction, for slab tests against many
+// boxes. A zero component is an infinity, which the slab test handles
+struct InverseRay {
+  float3 origin;
+  float3 inverse;
+
+  InverseRay(const Ray &ray)
+      : origin(ray.origin), inverse{1 / ray.direction[0], 1 / ray.direction[1],
+                                    1 / ray.direction[2]} {}
+};
+
+template <typename T>
+void TransformRays(const T &transform, const Ray *src, size_t count,
+                   Ray *dst) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = src[i].Transform(transform);
+  }
+}
+
 struct Plane {
   float3 normal;
   float3 pointOnPlane;
@@ -595,6 +729,152 @@ inline float operator>>(const Ray &ray, const Plane &plane) {
   return NQ / NV;
 }
 
+struct AABB {
+  float3 min{std::numeric_limits<float>::infinity(),
+             std::numeric_limits<float>::infinity(),
+             std::numeric_limits<float>::infinity()};
+  float3 max{-std::numeric_limits<float>::infinity(),
+             -std::numeric_limits<float>::infinity(),
+             -std::numeric_limits<float>::infinity()};
+
+  void Extend(const float3 &p) {
+    for (int i = 0; i < 3; ++i) {
+      if (p[i] < min[i])
+        min[i] = p[i];
+      if (p[i] > max[i])
+        max[i] = p[i];
+    }
+  }
+
+  void Merge(const AABB &aabb) {
+    Extend(aabb.min);
+    Extend(aabb.max);
+  }
+
+  float3 Center() const {
+    return {(min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f,
+            (min[2] + max[2]) * 0.5f};
+  }
+
+  float3 Extent() const {
+    return {(max[0] - min[0]) * 0.5f, (max[1] - min[1]) * 0.5f,
+            (max[2] - min[2]) * 0.5f};
+  }
+
+  AABB Grow(float margin) const {
+    return {Sub(min, {margin, margin, margin}),
+            Add(max, {margin, margin, margin})};
+  }
+
+  // t where the ray enters, 0 from inside. infinity on a miss or past tMax
+  float Enter(const InverseRay &ray,
+              float tMax = std::numeric_limits<float>::infinity()) const {
+    float t0 = 0;
+    float t1 = tMax;
+    for (int i = 0; i < 3; ++i) {
+      auto tNear = (min[i] - ray.origin[i]) * ray.inverse[i];
+      auto tFar = (max[i] - ray.origin[i]) * ray.inverse[i];
+      if (tNear > tFar) {
+        std::swap(tNear, tFar);
+      }
+      // NaN of an origin on a parallel slab keeps the interval
+      t0 = tNear > t0 ? tNear : t0;
+      t1 = tFar < t1 ? tFar : t1;
+    }
+    return t0 <= t1 ? t0 : std::numeric_limits<float>::infinity();
+  }
+
+  // bounds of the transformed box
+  AABB Transform(const falg::Transform &t) const {
+    return Transform(Affine(t));
+  }
+
+  AABB Transform(const Translation &t) const {
+    return {Add(min, t.t), Add(max, t.t)};
+  }
+
+  AABB Transform(const Affine &a) const {
+    auto c = a.ApplyPosition(Center());
+    auto e = Extent();
+    float3 rows[] = {a.x, a.y, a.z};
+    AABB aabb;
+    for (int j = 0; j < 3; ++j) {
+      auto r = std::abs(rows[0][j]) * e[0] + std::abs(rows[1][j]) * e[1] +
+               std::abs(rows[2][j]) * e[2];
+      aabb.min[j] = c[j] - r;
+      aabb.max[j] = c[j] + r;
+    }
+    return aabb;
+  }
+};
+
+struct Sphere {
+  float3 center;
+  float radius = 0;
+
+  // t is rigid, the radius does not change
+  template <typename T> Sphere Transform(const T &t) const {
+    return {t.ApplyPosition(center), radius};
+  }
+
+  Sphere Grow(float margin) const { return {center, radius + margin}; }
+
+  // the ray passes within radius ahead of its origin, or starts inside
+  bool Intersects(const Ray &ray) const {
+    auto oc = Sub(ray.origin, center);
+    auto c = Dot(oc, oc) - radius * radius;
+    if (c <= 0) {
+      return true;
+    }
+    auto b = Dot(oc, ray.direction);
+    return b < 0 && b * b >= Dot(ray.direction, ray.direction) * c;
+  }
+};
+
+// The planes of a view projection. A point p is inside when
+// Dot(plane.xyz, p) + plane.w >= 0 for all planes. The default Frustum
+// contains everything
+struct Frustum {
+  // left, right, bottom, top, near, far
+  std::array<float4, 6> planes{};
+
+  Frustum() = default;
+
+  // m is a row vector, row major view projection. The near plane is
+  // -w <= z, which also contains the 0 <= z of D3D
+  Frustum(const float16 &m) {
+    // clip = (p, 1) * m. a clip coordinate is a column of m
+    auto column = [&m](int j) {
+      return float4{m[j], m[4 + j], m[8 + j], m[12 + j]};
+    };
+    auto x = column(0);
+    auto y = column(1);
+    auto z = column(2);
+    auto w = column(3);
+    planes = {Add(w, x), Sub(w, x), Add(w, y),
+              Sub(w, y), Add(w, z), Sub(w, z)};
+    for (auto &p : planes) {
+      auto l = Length(float3{p[0], p[1], p[2]});
+      if (l > 0) {
+        p = MulScalar(p, 1 / l);
+      }
+    }
+  }
+
+  // false if the sphere is completely outside a plane. a sphere near a
+  // corner may be outside and still pass
+  bool Intersects(const Sphere &s) const {
+    for (auto &p : planes) {
+      if (p[0] * s.center[0] + p[1] * s.center[1] + p[2] * s.center[2] +
+              p[3] <
+          -s.radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
 struct Triangle {
   float3 v0;
   float3 v1;
@@ -603,16 +883,17 @@ struct Triangle {
 
 // float intersect_ray_triangle(const ray &ray, const minalg::float3 &v0, const
 // minalg::float3 &v1, const minalg::float3 &v2)
-inline float operator>>(const Ray &ray, const Triangle &triangle) {
-  auto e1 = Sub(triangle.v1, triangle.v0);
-  auto e2 = Sub(triangle.v2, triangle.v0);
+// t of the hit, infinity on a miss. *pu and *pv are the barycentrics of v1
+// and v2 at the hit
+inline float Intersect(const Ray &ray, const float3 &v0, const float3 &e1,
+                       const float3 &e2, float *pu, float *pv) {
   auto h = Cross(ray.direction, e2);
   auto a = Dot(e1, h);
   if (std::abs(a) == 0)
     return std::numeric_limits<float>::infinity();
 
   float f = 1 / a;
-  auto s = Sub(ray.origin, triangle.v0);
+  auto s = Sub(ray.origin, v0);
   auto u = f * Dot(s, h);
   if (u < 0 || u > 1)
     return std::numeric_limits<float>::infinity();
@@ -626,9 +907,729 @@ inline float operator>>(const Ray &ray, const Triangle &triangle) {
   if (t < 0)
     return std::numeric_limits<float>::infinity();
 
+  *pu = u;
+  *pv = v;
+  return t;
+}
+
+// with the edges of the triangle
+inline float Intersect(const Ray &ray, const Triangle &triangle, float *pu,
+                       float *pv) {
+  return Intersect(ray, triangle.v0, Sub(triangle.v1, triangle.v0),
+                   Sub(triangle.v2, triangle.v0), pu, pv);
+}
+
+inline float operator>>(const Ray &ray, const Triangle &triangle) {
+  float u, v;
+  return Intersect(ray, triangle, &u, &v);
+}
+
+///
+/// WIDTH triangles by coordinate, for one ray against all of them at once.
+///
+/// The edges are precomputed. Unused lanes are degenerate, no ray hits them.
+///
+struct TrianglePacket {
+#ifdef FALG_SIMD
+  static const int WIDTH = FALG_SIMD;
+#else
+  static const int WIDTH = 4;
+#endif
+  // [coordinate][lane]. e1 is v1 - v0, e2 is v2 - v0
+  float v0[3][WIDTH] = {};
+  float e1[3][WIDTH] = {};
+  float e2[3][WIDTH] = {};
+
+  TrianglePacket() = default;
+  // count is at most WIDTH
+  TrianglePacket(const Triangle *triangles, int count) {
+    for (int i = 0; i < count; ++i) {
+      auto &t = triangles[i];
+      auto edge1 = Sub(t.v1, t.v0);
+      auto edge2 = Sub(t.v2, t.v0);
+      for (int c = 0; c < 3; ++c) {
+        v0[c][i] = t.v0[c];
+        e1[c][i] = edge1[c];
+        e2[c][i] = edge2[c];
+      }
+    }
+  }
+
+  float3 Lane(const float (&values)[3][WIDTH], int lane) const {
+    return {values[0][lane], values[1][lane], values[2][lane]};
+  }
+};
+
+// FALG_SIMD floats. used by the vertex kernel of gizmesh too
+#if FALG_SIMD == 8
+struct simd {
+  using type = __m256;
+  static type load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, type v) { _mm256_storeu_ps(p, v); }
+  static type set(float f) { return _mm256_set1_ps(f); }
+  static type add(type l, type r) { return _mm256_add_ps(l, r); }
+  static type sub(type l, type r) { return _mm256_sub_ps(l, r); }
+  static type mul(type l, type r) { return _mm256_mul_ps(l, r); }
+  static type div(type l, type r) { return _mm256_div_ps(l, r); }
+  static type bit_and(type l, type r) { return _mm256_and_ps(l, r); }
+  static type not_equal(type l, type r) {
+    return _mm256_cmp_ps(l, r, _CMP_NEQ_OQ);
+  }
+  static type less(type l, type r) { return _mm256_cmp_ps(l, r, _CMP_LT_OQ); }
+  static type less_equal(type l, type r) {
+    return _mm256_cmp_ps(l, r, _CMP_LE_OQ);
+  }
+  static int mask(type v) { return _mm256_movemask_ps(v); }
+};
+#elif FALG_SIMD == 4
+struct simd {
+  using type = __m128;
+  static type load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, type v) { _mm_storeu_ps(p, v); }
+  static type set(float f) { return _mm_set1_ps(f); }
+  static type add(type l, type r) { return _mm_add_ps(l, r); }
+  static type sub(type l, type r) { return _mm_sub_ps(l, r); }
+  static type mul(type l, type r) { return _mm_mul_ps(l, r); }
+  static type div(type l, type r) { return _mm_div_ps(l, r); }
+  static type bit_and(type l, type r) { return _mm_and_ps(l, r); }
+  static type not_equal(type l, type r) { return _mm_cmpneq_ps(l, r); }
+  static type less(type l, type r) { return _mm_cmplt_ps(l, r); }
+  static type less_equal(type l, type r) { return _mm_cmple_ps(l, r); }
+  static int mask(type v) { return _mm_movemask_ps(v); }
+};
+#endif
+
+// The nearest triangle of the packet the ray hits before tMax. t of the hit,
+// infinity on a miss. *lane is the triangle, *pu and *pv its barycentrics.
+// The operations of Intersect(ray, triangle) in the same order. The hits are
+// the same unless the compiler contracts the scalar test into FMA
+inline float Intersect(const Ray &ray, const TrianglePacket &packet,
+                       float tMax, int *lane, float *pu, float *pv) {
+  const int W = TrianglePacket::WIDTH;
+  float ts[W];
+  float us[W];
+  float vs[W];
+  int hits = 0;
+#ifdef FALG_SIMD
+  using V = simd::type;
+  auto dot = [](const V *l, const V *r) {
+    return simd::add(simd::add(simd::mul(l[0], r[0]), simd::mul(l[1], r[1])),
+                     simd::mul(l[2], r[2]));
+  };
+  auto cross = [](const V *l, const V *r, V *out) {
+    out[0] = simd::sub(simd::mul(l[1], r[2]), simd::mul(l[2], r[1]));
+    out[1] = simd::sub(simd::mul(l[2], r[0]), simd::mul(l[0], r[2]));
+    out[2] = simd::sub(simd::mul(l[0], r[1]), simd::mul(l[1], r[0]));
+  };
+  V d[3];
+  V e1[3];
+  V e2[3];
+  V s[3];
+  for (int c = 0; c < 3; ++c) {
+    d[c] = simd::set(ray.direction[c]);
+    e1[c] = simd::load(packet.e1[c]);
+    e2[c] = simd::load(packet.e2[c]);
+    s[c] = simd::sub(simd::set(ray.origin[c]), simd::load(packet.v0[c]));
+  }
+  V h[3];
+  cross(d, e2, h);
+  auto a = dot(e1, h);
+  auto zero = simd::set(0);
+  auto one = simd::set(1);
+  auto f = simd::div(one, a);
+  auto u = simd::mul(f, dot(s, h));
+  V q[3];
+  cross(s, e1, q);
+  auto v = simd::mul(f, dot(d, q));
+  auto t = simd::mul(f, dot(e2, q));
+  // a degenerate lane has a NaN u
+  auto valid = simd::bit_and(simd::not_equal(a, zero),
+                             simd::bit_and(simd::less_equal(zero, u),
+                                           simd::less_equal(u, one)));
+  valid = simd::bit_and(valid,
+                        simd::bit_and(simd::less_equal(zero, v),
+                                      simd::less_equal(simd::add(u, v), one)));
+  valid = simd::bit_and(valid, simd::bit_and(simd::less_equal(zero, t),
+                                             simd::less(t, simd::set(tMax))));
+  hits = simd::mask(valid);
+  if (!hits) {
+    return std::numeric_limits<float>::infinity();
+  }
+  simd::store(ts, t);
+  simd::store(us, u);
+  simd::store(vs, v);
+#else
+  for (int i = 0; i < W; ++i) {
+    ts[i] = Intersect(ray, packet.Lane(packet.v0, i),
+                      packet.Lane(packet.e1, i), packet.Lane(packet.e2, i),
+                      &us[i], &vs[i]);
+    if (ts[i] < tMax) {
+      hits |= 1 << i;
+    }
+  }
+#endif
+  // the first lane of the smallest t
+  auto best = std::numeric_limits<float>::infinity();
+  for (int i = 0; i < W; ++i) {
+    if ((hits & (1 << i)) && ts[i] < best) {
+      best = ts[i];
+      *lane = i;
+      *pu = us[i];
+      *pv = vs[i];
+    }
+  }
+  return best;
+}
+
+struct Segment {
+  float3 v0;
+  float3 v1;
+};
+
+// Distance between the ray and the segment at their closest points. *t is
+// the ray parameter of its closest point, which is not negative.
+// Ericson, Real-Time Collision Detection 5.1.9 with an unbounded ray
+inline float Distance(const Ray &ray, const Segment &segment, float *t) {
+  auto d = Sub(segment.v1, segment.v0);
+  auto r = Sub(ray.origin, segment.v0);
+  auto a = Dot(ray.direction, ray.direction);
+  auto b = Dot(ray.direction, d);
+  auto c = Dot(ray.direction, r);
+  auto e = Dot(d, d);
+  auto f = Dot(d, r);
+  // the closest point of the ray to a point of the segment
+  auto onRay = [a](float numerator) {
+    auto s = a > 0 ? numerator / a : 0;
+    return s < 0 ? 0 : s;
+  };
+
+  float s = 0;
+  float u = 0;
+  if (e == 0) {
+    // a point
+    s = onRay(-c);
+  } else {
+    auto denom = a * e - b * b;
+    // parallel takes the origin
+    s = denom > 0 ? (b * f - c * e) / denom : 0;
+    if (s < 0) {
+      s = 0;
+    }
+    u = (b * s + f) / e;
+    if (u < 0) {
+      u = 0;
+      s = onRay(-c);
+    } else if (u > 1) {
+      u = 1;
+      s = onRay(b - c);
+    }
+  }
+  *t = s;
+  return Length(Sub(ray.SetT(s), Add(segment.v0, MulScalar(d, u))));
+}
+
+// The shapes below take a normalized ray direction. A hit is the entry t,
+// infinity on a miss or behind the origin.
+
+// Inigo Quilez, ray-capsule intersection
+struct Capsule {
+  float3 v0;
+  float3 v1;
+  float radius;
+};
+
+inline float operator>>(const Ray &ray, const Capsule &capsule) {
+  auto inf = std::numeric_limits<float>::infinity();
+  auto ba = Sub(capsule.v1, capsule.v0);
+  auto oa = Sub(ray.origin, capsule.v0);
+  auto baba = Dot(ba, ba);
+  auto bard = Dot(ba, ray.direction);
+  auto baoa = Dot(ba, oa);
+  auto rdoa = Dot(ray.direction, oa);
+  auto oaoa = Dot(oa, oa);
+  auto r2 = capsule.radius * capsule.radius;
+  auto a = baba - bard * bard;
+  auto b = baba * rdoa - baoa * bard;
+  auto c = baba * oaoa - baoa * baoa - r2 * baba;
+  auto h = b * b - a * c;
+  if (h < 0) {
+    return inf;
+  }
+  if (a > 0) {
+    auto t = (-b - std::sqrt(h)) / a;
+    auto y = baoa + t * bard;
+    if (y > 0 && y < baba) {
+      return t < 0 ? inf : t;
+    }
+  }
+  // the spheres at the ends. both for a ray along the axis
+  auto best = inf;
+  for (auto &end : {capsule.v0, capsule.v1}) {
+    auto oc = Sub(ray.origin, end);
+    b = Dot(ray.direction, oc);
+    h = b * b - (Dot(oc, oc) - r2);
+    auto t = -b - std::sqrt(h);
+    if (h >= 0 && t >= 0 && t < best) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+// A capped cone, radius at the base
+struct Cone {
+  float3 base;
+  float3 tip;
+  float radius;
+};
+
+// Inigo Quilez, ray-capped cone intersection with a zero tip radius
+inline float operator>>(const Ray &ray, const Cone &cone) {
+  auto inf = std::numeric_limits<float>::infinity();
+  auto ba = Sub(cone.tip, cone.base);
+  auto oa = Sub(ray.origin, cone.base);
+  auto m0 = Dot(ba, ba);
+  auto m1 = Dot(oa, ba);
+  auto m2 = Dot(ray.direction, ba);
+  auto m3 = Dot(ray.direction, oa);
+  auto m5 = Dot(oa, oa);
+  auto ra = cone.radius;
+  if (m1 < 0) {
+    // below the base, the base disc
+    auto d = Sub(MulScalar(oa, m2), MulScalar(ray.direction, m1));
+    if (Dot(d, d) < ra * ra * m2 * m2) {
+      auto t = -m1 / m2;
+      return t < 0 ? inf : t;
+    }
+  }
+  auto hy = m0 + ra * ra;
+  auto k2 = m0 * m0 - m2 * m2 * hy;
+  auto k1 = m0 * m0 * m3 - m1 * m2 * hy + m0 * ra * ra * m2;
+  auto k0 = m0 * m0 * m5 - m1 * m1 * hy + m0 * ra * (ra * m1 * 2 - m0 * ra);
+  auto h = k1 * k1 - k2 * k0;
+  if (h < 0) {
+    return inf;
+  }
+  auto t = (-k1 - std::sqrt(h)) / k2;
+  auto y = m1 + t * m2;
+  if (y < 0 || y > m0 || t < 0) {
+    return inf;
+  }
   return t;
 }
 
+// roots of the polynomial c[0] + c[1] t + ... + c[n] t^n, c[n] != 0, n <= 4,
+// in [t0, t1] in ascending order. bisects where the sign changes between the
+// roots of the derivative, so a root where the curve only touches zero is lost
+inline int PolynomialRoots(const double *c, int n, double t0, double t1,
+                           double *roots) {
+  auto evaluate = [c, n](double t) {
+    auto y = c[n];
+    for (int i = n - 1; i >= 0; --i) {
+      y = y * t + c[i];
+    }
+    return y;
+  };
+  double bounds[6];
+  int count = 0;
+  bounds[count++] = t0;
+  if (n == 1) {
+    auto t = -c[0] / c[1];
+    if (t >= t0 && t <= t1) {
+      roots[0] = t;
+      return 1;
+    }
+    return 0;
+  }
+  double derivative[4];
+  for (int i = 1; i <= n; ++i) {
+    derivative[i - 1] = c[i] * i;
+  }
+  count += PolynomialRoots(derivative, n - 1, t0, t1, bounds + 1);
+  bounds[count++] = t1;
+
+  int found = 0;
+  for (int i = 0; i + 1 < count; ++i) {
+    auto lo = bounds[i];
+    auto hi = bounds[i + 1];
+    auto ylo = evaluate(lo);
+    auto yhi = evaluate(hi);
+    if (ylo == 0) {
+      roots[found++] = lo;
+      continue;
+    }
+    if ((ylo < 0) == (yhi < 0)) {
+      continue;
+    }
+    for (int k = 0; k < 48; ++k) {
+      auto mid = (lo + hi) / 2;
+      auto y = evaluate(mid);
+      if ((y < 0) == (ylo < 0)) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    roots[found++] = (lo + hi) / 2;
+  }
+  return found;
+}
+
+// A ring around axis, which is normalized
+struct Torus {
+  float3 center;
+  float3 axis;
+  float radius;
+  float thickness;
+};
+
+// the first root of (|p|^2 + R^2 - r^2)^2 = 4 R^2 |p - axis (p . axis)|^2
+// within the bounding sphere
+inline float operator>>(const Ray &ray, const Torus &torus) {
+  auto inf = std::numeric_limits<float>::infinity();
+  auto o = Sub(ray.origin, torus.center);
+  auto &d = ray.direction;
+  double R2 = torus.radius * torus.radius;
+  double r2 = torus.thickness * torus.thickness;
+  double b = Dot(o, d);
+  double oo = Dot(o, o);
+  auto bound = torus.radius + torus.thickness;
+  auto h = b * b - (oo - bound * bound);
+  if (h < 0) {
+    return inf;
+  }
+  h = std::sqrt(h);
+  if (-b + h < 0) {
+    return inf;
+  }
+  double on = Dot(o, torus.axis);
+  double dn = Dot(d, torus.axis);
+  auto k = oo + R2 - r2;
+  double c[5] = {
+      k * k - 4 * R2 * (oo - on * on),
+      4 * b * k - 8 * R2 * (b - on * dn),
+      4 * b * b + 2 * k - 4 * R2 * (1 - dn * dn),
+      4 * b,
+      1,
+  };
+  double roots[4];
+  auto t0 = -b - h;
+  if (!PolynomialRoots(c, 4, t0 < 0 ? 0 : t0, -b + h, roots)) {
+    return inf;
+  }
+  return static_cast<float>(roots[0]);
+}
+
+// t of the entry, 0 from inside
+inline float operator>>(const Ray &ray, const AABB &aabb) {
+  return aabb.Enter(InverseRay(ray));
+}
+
+// The nearest hit of a ray query
+struct RayHit {
+  float t = std::numeric_limits<float>::infinity();
+  // index in the source triangle list, ~0u on a miss
+  uint32_t triangle = ~0u;
+  // barycentrics of v1 and v2
+  float u = 0;
+  float v = 0;
+
+  bool Hit() const { return triangle != ~0u; }
+};
+
+///
+/// Bounding volume hierarchy of a triangle list, or of boxes, for ray queries.
+///
+/// Built with a binned SAH. The nodes are flattened depth first, the first
+/// child of an inner node follows it. The triangles are copied in leaf order
+/// into TrianglePackets, a leaf per packet, so a query reads no source data.
+///
+class Bvh {
+public:
+  struct Node {
+    AABB bounds;
+    // leaf: first item. inner: the second child
+    uint32_t offset;
+    // items of a leaf, 0 for an inner node
+    uint32_t count;
+  };
+
+private:
+  std::vector<Node> m_nodes;
+  // in leaf order, a leaf starts a packet. empty for boxes
+  std::vector<TrianglePacket> m_packets;
+  // source index of each item in leaf order. ~0u in the unused lanes of
+  // m_packets
+  std::vector<uint32_t> m_ids;
+  uint32_t m_maxLeaf = MAX_LEAF;
+
+  static const int BINS = 12;
+  static const uint32_t MAX_LEAF = 4;
+  // deeper nodes are leaves, so the stack of a query is bounded
+  static const int MAX_DEPTH = 48;
+
+  static float HalfArea(const AABB &b) {
+    auto e = Sub(b.max, b.min);
+    return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+  }
+
+  static float Centroid(const AABB &b, int axis) {
+    return (b.min[axis] + b.max[axis]) * 0.5f;
+  }
+
+  static int Bin(float centroid, float min, float scale) {
+    auto b = static_cast<int>((centroid - min) * scale);
+    return b < BINS ? b : BINS - 1;
+  }
+
+  // m_ids[begin, end) into node and its children
+  void Split(uint32_t node, uint32_t begin, uint32_t end, int depth,
+             const AABB *bounds) {
+    AABB box;
+    AABB centroidBox;
+    for (auto i = begin; i < end; ++i) {
+      auto &b = bounds[m_ids[i]];
+      box.Merge(b);
+      centroidBox.Extend({Centroid(b, 0), Centroid(b, 1), Centroid(b, 2)});
+    }
+    m_nodes[node].bounds = box;
+
+    // a node test costs as much as an item test
+    auto count = end - begin;
+    auto bestCost = count * HalfArea(box);
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3 && count > m_maxLeaf && depth < MAX_DEPTH;
+         ++axis) {
+      auto min = centroidBox.min[axis];
+      auto extent = centroidBox.max[axis] - min;
+      if (extent <= 0) {
+        continue;
+      }
+      auto scale = BINS / extent;
+      AABB binBounds[BINS];
+      uint32_t binCounts[BINS] = {};
+      for (auto i = begin; i < end; ++i) {
+        auto &b = bounds[m_ids[i]];
+        auto bin = Bin(Centroid(b, axis), min, scale);
+        ++binCounts[bin];
+        binBounds[bin].Merge(b);
+      }
+
+      // the right side of each plane, then the left side in one sweep
+      float rightArea[BINS] = {};
+      uint32_t rightCount[BINS] = {};
+      AABB right;
+      uint32_t n = 0;
+      for (int b = BINS - 1; b > 0; --b) {
+        if (binCounts[b]) {
+          right.Merge(binBounds[b]);
+          n += binCounts[b];
+        }
+        rightArea[b] = n ? HalfArea(right) : 0;
+        rightCount[b] = n;
+      }
+      AABB left;
+      n = 0;
+      for (int b = 0; b < BINS - 1; ++b) {
+        if (binCounts[b]) {
+          left.Merge(binBounds[b]);
+          n += binCounts[b];
+        }
+        if (!n || !rightCount[b + 1]) {
+          continue;
+        }
+        auto cost = HalfArea(box) + n * HalfArea(left) +
+                    rightCount[b + 1] * rightArea[b + 1];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = b;
+        }
+      }
+    }
+
+    if (bestAxis < 0) {
+      m_nodes[node].offset = begin;
+      m_nodes[node].count = count;
+      return;
+    }
+
+    auto min = centroidBox.min[bestAxis];
+    auto scale = BINS / (centroidBox.max[bestAxis] - min);
+    auto middle = begin;
+    for (auto i = begin; i < end; ++i) {
+      if (Bin(Centroid(bounds[m_ids[i]], bestAxis), min, scale) <= bestBin) {
+        std::swap(m_ids[i], m_ids[middle++]);
+      }
+    }
+    auto first = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({});
+    Split(first, begin, middle, depth + 1, bounds);
+    auto second = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({});
+    Split(second, middle, end, depth + 1, bounds);
+    m_nodes[node].offset = second;
+    m_nodes[node].count = 0;
+  }
+
+  // the leaves along the ray, nearest first. leaf(node, tMax) returns the
+  // nearest t of its items, if less than tMax
+  template <typename F>
+  float Leaves(const Ray &ray, F &&leaf, float tMax) const {
+    if (m_nodes.empty()) {
+      return tMax;
+    }
+    InverseRay inverse(ray);
+    uint32_t stack[MAX_DEPTH + 2];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+      auto index = stack[--top];
+      auto &node = m_nodes[index];
+      if (std::isinf(node.bounds.Enter(inverse, tMax))) {
+        continue;
+      }
+      if (node.count) {
+        tMax = leaf(node, tMax);
+        continue;
+      }
+      // the nearer child is popped first
+      uint32_t first = index + 1;
+      uint32_t second = node.offset;
+      auto tFirst = m_nodes[first].bounds.Enter(inverse, tMax);
+      auto tSecond = m_nodes[second].bounds.Enter(inverse, tMax);
+      if (tSecond < tFirst) {
+        std::swap(first, second);
+        std::swap(tFirst, tSecond);
+      }
+      if (!std::isinf(tSecond)) {
+        stack[top++] = second;
+      }
+      if (!std::isinf(tFirst)) {
+        stack[top++] = first;
+      }
+    }
+    return tMax;
+  }
+
+public:
+  Bvh() = default;
+
+  // positions are float3 stride bytes apart, three indices per triangle.
+  // I is uint16_t or uint32_t
+  template <typename I>
+  Bvh(const void *positions, size_t stride, const I *indices,
+      size_t indexCount) {
+    auto position = [&](I i) -> const float3 & {
+      return *reinterpret_cast<const float3 *>(
+          static_cast<const uint8_t *>(positions) + i * stride);
+    };
+    auto count = static_cast<uint32_t>(indexCount / 3);
+    std::vector<Triangle> triangles(count);
+    std::vector<AABB> bounds(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      auto &t = triangles[i];
+      t = {position(indices[i * 3]), position(indices[i * 3 + 1]),
+           position(indices[i * 3 + 2])};
+      bounds[i].Extend(t.v0);
+      bounds[i].Extend(t.v1);
+      bounds[i].Extend(t.v2);
+    }
+    const int W = TrianglePacket::WIDTH;
+    Build(bounds.data(), count, W);
+
+    // leaves start at a packet
+    std::vector<uint32_t> ids;
+    for (auto &node : m_nodes) {
+      if (!node.count) {
+        continue;
+      }
+      auto offset = static_cast<uint32_t>(ids.size());
+      ids.insert(ids.end(), m_ids.begin() + node.offset,
+                 m_ids.begin() + node.offset + node.count);
+      ids.resize((ids.size() + W - 1) / W * W, ~0u);
+      node.offset = offset;
+    }
+    m_ids.swap(ids);
+    m_packets.resize(m_ids.size() / W);
+    for (size_t p = 0; p < m_packets.size(); ++p) {
+      Triangle lanes[W];
+      int n = 0;
+      for (; n < W && m_ids[p * W + n] != ~0u; ++n) {
+        lanes[n] = triangles[m_ids[p * W + n]];
+      }
+      m_packets[p] = TrianglePacket(lanes, n);
+    }
+  }
+
+  // storage for Build of count boxes, which then does not allocate
+  void Reserve(size_t count) {
+    m_nodes.reserve(count * 2);
+    m_ids.reserve(count);
+  }
+
+  // over boxes, replacing the last build. the leaf items of Traverse are the
+  // boxes, up to maxLeaf in a leaf above the depth limit. keeps the storage
+  void Build(const AABB *bounds, size_t count, uint32_t maxLeaf = MAX_LEAF) {
+    m_nodes.clear();
+    m_packets.clear();
+    m_maxLeaf = maxLeaf;
+    m_ids.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      m_ids[i] = static_cast<uint32_t>(i);
+    }
+    if (count) {
+      Reserve(count);
+      m_nodes.push_back({});
+      Split(0, 0, static_cast<uint32_t>(count), 0, bounds);
+    }
+  }
+
+  const std::vector<Node> &Nodes() const { return m_nodes; }
+
+  // the items along the ray, nearest first. hit(id, tMax) tests the item of
+  // source index id and returns its t, infinity on a miss. the nodes behind
+  // the nearest t so far are skipped. returns the nearest t
+  template <typename F>
+  float Traverse(const Ray &ray, F &&hit,
+                 float tMax = std::numeric_limits<float>::infinity()) const {
+    auto items = [&](const Node &node, float t) {
+      for (auto i = node.offset; i < node.offset + node.count; ++i) {
+        auto d = hit(m_ids[i], t);
+        if (d < t) {
+          t = d;
+        }
+      }
+      return t;
+    };
+    return Leaves(ray, items, tMax);
+  }
+
+  RayHit Raycast(const Ray &ray) const {
+    RayHit hit;
+    const int W = TrianglePacket::WIDTH;
+    auto packets = [&](const Node &node, float tMax) {
+      for (auto i = node.offset; i < node.offset + node.count; i += W) {
+        int lane = 0;
+        float u = 0, v = 0;
+        auto t = Intersect(ray, m_packets[i / W], tMax, &lane, &u, &v);
+        if (t < tMax) {
+          tMax = t;
+          hit = {t, m_ids[i + lane], u, v};
+        }
+      }
+      return tMax;
+    };
+    Leaves(ray, packets, std::numeric_limits<float>::infinity());
+    return hit;
+  }
+};
+
+inline float operator>>(const Ray &ray, const Bvh &bvh) {
+  return bvh.Raycast(ray).t;
+}
+
 struct Matrix2x3 {
   float3 x;
   float3 y;
@@ -3,6 +3,9 @@
 #include <DirectXMath.h>
 #include <catch.hpp>
 #include <falg.h>
+#include <geometry_mesh.h>
+#include <gizmesh.h>
+#include <vertex_kernel.h>
 
 
 TEST_CASE("T", "[template]") {
@@ -60,3 +63,521 @@ TEST_CASE("Transform", "[order]") {
   auto c = (a * b).ApplyPosition({1, 0, 0});
   REQUIRE(falg::Nearly(c, std::array<float, 3>{1, 0, -2}));
 }
+
+TEST_CASE("AABB", "[transform]") {
+  falg::AABB aabb;
+  aabb.Extend({-1, -2, -3});
+  aabb.Extend({1, 2, 3});
+  REQUIRE(aabb.Center() == std::array<float, 3>{0, 0, 0});
+  REQUIRE(aabb.Extent() == std::array<float, 3>{1, 2, 3});
+
+  auto t = falg::Transform{
+      {1, 0, 0},
+      falg::QuaternionAxisAngle({0, 0, 1}, 90.0f * falg::TO_RADIANS)};
+  auto moved = aabb.Transform(t);
+  REQUIRE(falg::Nearly(moved.min, std::array<float, 3>{-1, -1, -3}));
+  REQUIRE(falg::Nearly(moved.max, std::array<float, 3>{3, 1, 3}));
+}
+
+TEST_CASE("Affine", "[transform]") {
+  auto t = falg::Transform{
+      {1, 2, 3},
+      falg::QuaternionAxisAngle({0, 1, 0}, 30.0f * falg::TO_RADIANS)};
+  falg::Affine a(t);
+  falg::float3 p{4, 5, 6};
+  REQUIRE(a.ApplyPosition(p) == t.ApplyPosition(p));
+  REQUIRE(a.ApplyDirection(p) == t.ApplyDirection(p));
+  REQUIRE(falg::Nearly(a.RowMatrix(), t.RowMatrix()));
+  REQUIRE(falg::Nearly(a.Inverse().ApplyPosition(a.ApplyPosition(p)), p));
+
+  falg::TRS trs({1, 2, 3}, t.rotation, {2, 2, 2});
+  REQUIRE(falg::Nearly(falg::Affine(trs).RowMatrix(), trs.RowMatrix()));
+
+  falg::float3 points[] = {{0, 0, 0}, {1, 0, 0}};
+  falg::float3 moved[2];
+  falg::ApplyPositions(a, points, 2, moved);
+  REQUIRE(moved[1] == t.ApplyPosition(points[1]));
+}
+
+TEST_CASE("vertex_kernel", "[transform]") {
+  // not a multiple of soa_width, the tail is padding
+  std::vector<falg::float3> points;
+  for (int i = 0; i < 13; ++i) {
+    points.push_back({i * 0.5f, 1 - i * 0.25f, i * i * 0.125f});
+  }
+  gizmesh::soa_float3 soa(points, [](const falg::float3 &p) -> auto & {
+    return p;
+  });
+  REQUIRE(soa.padded() % gizmesh::soa_width == 0);
+  REQUIRE(soa.padded() > points.size());
+
+  falg::Affine a(falg::Transform{
+      {1, 2, 3},
+      falg::QuaternionAxisAngle({1, 1, 0}, 40.0f * falg::TO_RADIANS)});
+  auto n = soa.padded();
+  std::vector<float> x(n), y(n), z(n);
+  auto check = [&](auto apply) {
+    for (size_t i = 0; i < n; ++i) {
+      // padding is the origin
+      auto p = i < points.size() ? points[i] : falg::float3{0, 0, 0};
+      REQUIRE(falg::Nearly(falg::float3{x[i], y[i], z[i]}, apply(p)));
+    }
+  };
+  gizmesh::transform_positions(a, soa, 0, n, x.data(), y.data(), z.data());
+  check([&](const falg::float3 &p) { return a.ApplyPosition(p); });
+  gizmesh::transform_directions(a, soa, 0, n, x.data(), y.data(), z.data());
+  check([&](const falg::float3 &p) { return a.ApplyDirection(p); });
+  falg::Translation t{{1, 2, 3}};
+  gizmesh::transform_positions(t, soa, 0, n, x.data(), y.data(), z.data());
+  check([&](const falg::float3 &p) { return t.ApplyPosition(p); });
+}
+
+TEST_CASE("geometry_optimize", "[mesh]") {
+  falg::float2 points[] = {{0.25f, 0}, {0.25f, 0.05f}, {1, 0.05f},
+                           {1, 0.10f}, {1.2f, 0}};
+  auto mesh = gizmesh::geometry_mesh::make_lathed_geometry(
+      {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 16, points, 5);
+  // the triangles by position, in any order
+  auto triangles = [](const gizmesh::geometry_mesh &m) {
+    std::vector<std::array<float, 9>> list;
+    for (size_t i = 0; i + 2 < m.triangles.size(); i += 3) {
+      std::array<float, 9> t;
+      for (int k = 0; k < 3; ++k) {
+        auto &p = m.vertices[m.triangles[i + k]].position;
+        std::copy(p.begin(), p.end(), t.begin() + k * 3);
+      }
+      list.push_back(t);
+    }
+    std::sort(list.begin(), list.end());
+    return list;
+  };
+
+  auto vertexCount = mesh.vertices.size();
+  mesh.weld();
+  // the seam
+  REQUIRE(mesh.vertices.size() < vertexCount);
+  auto welded = triangles(mesh);
+  auto acmr = mesh.acmr();
+  mesh.optimize_vertex_cache();
+  mesh.optimize_vertex_fetch();
+  REQUIRE(triangles(mesh) == welded);
+  REQUIRE(mesh.acmr() <= acmr);
+}
+
+TEST_CASE("Translation", "[transform]") {
+  falg::Transform t{{1, 2, 3}, {0, 0, 0, 1}};
+  falg::float3 p{4, 5, 6};
+  auto kind = falg::DispatchTransform(t, [&](const auto &m) {
+    REQUIRE(m.ApplyPosition(p) == t.ApplyPosition(p));
+    REQUIRE(m.ApplyDirection(p) == p);
+    REQUIRE(m.Inverse().ApplyPosition(m.ApplyPosition(p)) == p);
+    return std::is_same_v<std::decay_t<decltype(m)>, falg::Translation>;
+  });
+  REQUIRE(kind);
+
+  t.rotation = falg::QuaternionAxisAngle({0, 1, 0}, 1);
+  kind = falg::DispatchTransform(t, [&](const auto &m) {
+    REQUIRE(m.ApplyPosition(p) == t.ApplyPosition(p));
+    return std::is_same_v<std::decay_t<decltype(m)>, falg::Translation>;
+  });
+  REQUIRE(!kind);
+}
+
+TEST_CASE("Frustum", "[intersect]") {
+  // camera at z = 8 looking down -z
+  std::array<float, 16> projection;
+  falg::PerspectiveRHGL(projection.data(), 90.0f * falg::TO_RADIANS, 1.0f,
+                        0.1f, 100.0f);
+  falg::Frustum frustum(falg::TranslationMatrix(0, 0, -8) * projection);
+  REQUIRE(frustum.Intersects({{0, 0, 0}, 1}));
+  // the side planes are at 45 degrees, x = 8 at z = 0
+  REQUIRE(frustum.Intersects({{8.5f, 0, 0}, 1}));
+  REQUIRE(!frustum.Intersects({{10, 0, 0}, 1}));
+  // behind the camera and beyond the far plane
+  REQUIRE(!frustum.Intersects({{0, 0, 10}, 1}));
+  REQUIRE(!frustum.Intersects({{0, 0, -100}, 1}));
+
+  REQUIRE(falg::Frustum().Intersects({{1000, 0, 0}, 1}));
+}
+
+TEST_CASE("Segment", "[intersect]") {
+  falg::Ray ray{{0, 0, -5}, {0, 0, 1}};
+  float t;
+  // crosses 0.1 above the ray
+  REQUIRE(falg::Distance(ray, {{-1, 0.1f, 0}, {1, 0.1f, 0}}, &t) ==
+          Approx(0.1f));
+  REQUIRE(t == Approx(5));
+  // the closest point is the end v0
+  REQUIRE(falg::Distance(ray, {{2, 0, 0}, {3, 0, 0}}, &t) == Approx(2));
+  REQUIRE(t == Approx(5));
+  // behind the origin
+  REQUIRE(falg::Distance(ray, {{-1, 1, -10}, {1, 1, -10}}, &t) ==
+          Approx(std::sqrt(26.0f)));
+  REQUIRE(t == 0);
+  // parallel
+  REQUIRE(falg::Distance(ray, {{0, 1, 0}, {0, 1, 2}}, &t) == Approx(1));
+}
+
+TEST_CASE("Bvh", "[intersect]") {
+  // a bumpy grid of 2 * 16 * 16 triangles
+  const int N = 16;
+  std::vector<falg::float3> positions;
+  for (int y = 0; y <= N; ++y) {
+    for (int x = 0; x <= N; ++x) {
+      positions.push_back({static_cast<float>(x), static_cast<float>(y),
+                           std::sin(x * 0.7f) * std::cos(y * 0.4f)});
+    }
+  }
+  std::vector<uint16_t> indices;
+  for (int y = 0; y < N; ++y) {
+    for (int x = 0; x < N; ++x) {
+      uint16_t i = static_cast<uint16_t>(y * (N + 1) + x);
+      uint16_t quad[] = {i, static_cast<uint16_t>(i + 1),
+                         static_cast<uint16_t>(i + N + 2), i,
+                         static_cast<uint16_t>(i + N + 2),
+                         static_cast<uint16_t>(i + N + 1)};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+  falg::Bvh bvh(positions.data(), sizeof(positions[0]), indices.data(),
+                indices.size());
+  REQUIRE(bvh.Nodes().size() > 1);
+
+  uint32_t seed = 1;
+  auto next = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / (1 << 24);
+  };
+  int hits = 0;
+  for (int i = 0; i < 256; ++i) {
+    falg::Ray ray{{next() * N, next() * N, 4},
+                  falg::Normalize(falg::float3{next() - 0.5f, next() - 0.5f,
+                                               -1})};
+    falg::RayHit expected;
+    for (uint32_t t = 0; t < indices.size() / 3; ++t) {
+      falg::Triangle triangle{positions[indices[t * 3]],
+                              positions[indices[t * 3 + 1]],
+                              positions[indices[t * 3 + 2]]};
+      auto d = ray >> triangle;
+      if (d < expected.t) {
+        expected.t = d;
+        expected.triangle = t;
+      }
+    }
+    auto hit = bvh.Raycast(ray);
+    // the two inlined tests may be contracted differently
+    REQUIRE(hit.Hit() == expected.Hit());
+    REQUIRE(hit.triangle == expected.triangle);
+    if (hit.Hit()) {
+      REQUIRE(hit.t == Approx(expected.t));
+    }
+    if (hit.Hit()) {
+      ++hits;
+      // the barycentrics reproduce the point
+      auto &v0 = positions[indices[hit.triangle * 3]];
+      auto &v1 = positions[indices[hit.triangle * 3 + 1]];
+      auto &v2 = positions[indices[hit.triangle * 3 + 2]];
+      auto p = falg::Add(
+          v0, falg::Add(falg::MulScalar(falg::Sub(v1, v0), hit.u),
+                        falg::MulScalar(falg::Sub(v2, v0), hit.v)));
+      REQUIRE(falg::Length(falg::Sub(p, ray.SetT(hit.t))) < 1e-4f);
+    }
+  }
+  REQUIRE(hits > 0);
+  REQUIRE(!falg::Bvh().Raycast({{0, 0, 0}, {0, 0, 1}}).Hit());
+
+  // a column of boxes. the farther ones are pruned by the nearest hit
+  std::vector<falg::AABB> boxes;
+  for (int i = 0; i < 64; ++i) {
+    auto z = static_cast<float>(i) * -2;
+    boxes.push_back({{0, 0, z}, {1, 1, z + 1}});
+  }
+  bvh.Build(boxes.data(), boxes.size());
+  falg::Ray down{{0.5f, 0.5f, 4}, {0, 0, -1}};
+  uint32_t nearest = ~0u;
+  int visited = 0;
+  auto t = bvh.Traverse(down, [&](uint32_t i, float tMax) {
+    ++visited;
+    auto d = down >> boxes[i];
+    if (d < tMax) {
+      nearest = i;
+    }
+    return d;
+  });
+  REQUIRE(t == 3);
+  REQUIRE(nearest == 0);
+  REQUIRE(visited < 64);
+}
+
+TEST_CASE("TrianglePacket", "[intersect]") {
+  // a fan of triangles, the nearer ones later. one lane is left unused
+  const int W = falg::TrianglePacket::WIDTH;
+  std::vector<falg::Triangle> triangles;
+  for (int i = 0; i < W - 1; ++i) {
+    auto z = static_cast<float>(i);
+    triangles.push_back({{-1, -1, z}, {1 + i * 0.1f, -1, z}, {-1, 1, z}});
+  }
+  falg::TrianglePacket packet(triangles.data(), W - 1);
+
+  falg::Ray ray{{-0.5f, -0.5f, 10}, {0, 0, -1}};
+  int lane = -1;
+  float u = 0, v = 0;
+  auto t = falg::Intersect(ray, packet, 100, &lane, &u, &v);
+  REQUIRE(lane == W - 2);
+  float eu, ev;
+  // the scalar test may be contracted into FMA
+  REQUIRE(t == Approx(falg::Intersect(ray, triangles[lane], &eu, &ev)));
+  REQUIRE(u == Approx(eu));
+  REQUIRE(v == Approx(ev));
+  // only the hits before tMax
+  REQUIRE(std::isinf(falg::Intersect(ray, packet, t, &lane, &u, &v)));
+  // the unused lane is degenerate
+  REQUIRE(std::isinf(
+      falg::Intersect({{0, 0, 1}, {0, 0, -1}}, falg::TrianglePacket(), 100,
+                      &lane, &u, &v)));
+}
+
+TEST_CASE("Shapes", "[intersect]") {
+  falg::Ray ray{{0, 0, -5}, {0, 0, 1}};
+  // the side of a capsule along x, then the sphere at its end
+  REQUIRE((ray >> falg::Capsule{{-1, 0, 0}, {1, 0, 0}, 0.5f}) == Approx(4.5f));
+  REQUIRE((ray >> falg::Capsule{{0, 0, 1}, {0, 0, 2}, 0.5f}) == Approx(5.5f));
+  REQUIRE(std::isinf(ray >> falg::Capsule{{-1, 1, 0}, {1, 1, 0}, 0.5f}));
+  // the base disc of a cone facing the ray, then its side
+  REQUIRE((ray >> falg::Cone{{0, 0, 0}, {0, 0, 1}, 0.5f}) == Approx(5));
+  REQUIRE((ray >> falg::Cone{{0, 0, 1}, {0, 0, 0}, 0.5f}) == Approx(5));
+  REQUIRE(std::isinf(ray >> falg::Cone{{1, 0, 0}, {1, 1, 0}, 0.5f}));
+  // through the tube, not the hole
+  falg::Torus torus{{0, 0, 0}, {0, 0, 1}, 1, 0.1f};
+  REQUIRE(std::isinf(ray >> torus));
+  REQUIRE((falg::Ray{{1, 0, -5}, {0, 0, 1}} >> torus) == Approx(4.9f));
+  REQUIRE((falg::Ray{{-5, 0, 0}, {1, 0, 0}} >> torus) == Approx(3.9f));
+  // the box, and from inside it
+  falg::AABB box{{-1, -1, -1}, {1, 1, 1}};
+  REQUIRE((ray >> box) == Approx(4));
+  REQUIRE((falg::Ray{{0, 0, 0}, {0, 0, 1}} >> box) == 0);
+  REQUIRE(std::isinf(falg::Ray{{0, 0, 5}, {0, 0, 1}} >> box));
+}
+
+TEST_CASE("Bounds", "[intersect]") {
+  falg::Ray ray{{0, 0, -5}, {0, 0, 2}};
+  falg::Sphere sphere{{0, 1, 0}, 0.5f};
+  REQUIRE(!sphere.Intersects(ray));
+  REQUIRE(sphere.Grow(0.5f).Intersects(ray));
+  // behind the origin, and from inside
+  REQUIRE(!falg::Sphere{{0, 0, -10}, 1}.Intersects(ray));
+  REQUIRE(falg::Sphere{{0, 0, -5.5f}, 1}.Intersects(ray));
+
+  // t is of the unnormalized direction
+  falg::InverseRay inverse(ray);
+  falg::AABB box{{-1, -1, -1}, {1, 1, 1}};
+  REQUIRE(box.Enter(inverse) == Approx(2));
+  REQUIRE(std::isinf(box.Enter(inverse, 1)));
+  REQUIRE(std::isinf(box.Grow(-0.5f).Enter(falg::InverseRay(
+      {{0.75f, 0, -5}, {0, 0, 1}}))));
+  // parallel to two slabs
+  REQUIRE(box.Enter(falg::InverseRay({{-5, 0, 0}, {1, 0, 0}})) == Approx(4));
+}
+
+// GizmoSystem::OutputStream into vectors
+struct memory_stream : gizmesh::GizmoSystem::OutputStream {
+  std::vector<uint8_t> vertexBytes;
+  std::vector<uint8_t> indexBytes;
+  int reserves = 0;
+  bool accept = true;
+
+  bool reserve(uint32_t verticesBytes, uint32_t, uint32_t indicesBytes,
+               uint32_t) override {
+    ++reserves;
+    vertexBytes.assign(verticesBytes, 0);
+    indexBytes.assign(indicesBytes, 0);
+    return accept;
+  }
+  uint8_t *vertices(uint32_t offset, uint32_t) override {
+    return vertexBytes.data() + offset;
+  }
+  uint8_t *indices(uint32_t offset, uint32_t) override {
+    return indexBytes.data() + offset;
+  }
+};
+
+TEST_CASE("OutputStream", "[gizmesh]") {
+  using gizmesh::GizmoSystem;
+  for (auto primitive :
+       {GizmoSystem::Primitive::Triangles, GizmoSystem::Primitive::Lines}) {
+    GizmoSystem buffered;
+    GizmoSystem streamed;
+    buffered.set_primitive(primitive);
+    streamed.set_primitive(primitive);
+    memory_stream stream;
+    falg::float3 eye{1, 2, 6};
+    falg::float4 r{0, 0, 0, 1};
+    auto frame = [&](GizmoSystem &system, int f) {
+      system.begin(eye, r, eye, {0, 0, -1}, false);
+      // one moves, a translucent plane is sorted
+      falg::float3 t{f * 0.5f, 0, 0};
+      falg::float3 still{0, 1, 0};
+      falg::float3 s{1, 1, 1};
+      gizmesh::handle::translation(system, 1, true, nullptr, t, r);
+      gizmesh::handle::rotation(system, 2, true, nullptr, still, r);
+      gizmesh::handle::scale(system, 3, false, still, r, s);
+    };
+    for (int f = 0; f < 3; ++f) {
+      frame(buffered, f);
+      auto expected = buffered.end();
+      frame(streamed, f);
+      auto reserves = stream.reserves;
+      auto buffer = streamed.end(stream);
+      REQUIRE(stream.reserves == reserves + 1);
+      REQUIRE(buffer.pVertices == nullptr);
+      REQUIRE(buffer.overflow == 0);
+      REQUIRE(stream.vertexBytes.size() == expected.verticesBytes);
+      REQUIRE(std::equal(stream.vertexBytes.begin(), stream.vertexBytes.end(),
+                         expected.pVertices));
+      auto lines = primitive == GizmoSystem::Primitive::Lines;
+      auto indices = lines ? expected.pLineIndices : expected.pIndices;
+      REQUIRE(!stream.indexBytes.empty());
+      REQUIRE(stream.indexBytes.size() ==
+              (lines ? expected.lineIndicesBytes : expected.indicesBytes));
+      REQUIRE(std::equal(stream.indexBytes.begin(), stream.indexBytes.end(),
+                         indices));
+    }
+
+    // refused, nothing is written
+    stream.accept = false;
+    frame(streamed, 3);
+    auto buffer = streamed.end(stream);
+    REQUIRE((buffer.overflow & (GizmoSystem::OverflowVertices |
+                                GizmoSystem::OverflowIndices)) ==
+            (GizmoSystem::OverflowVertices | GizmoSystem::OverflowIndices));
+    REQUIRE(buffer.commandCount == 0);
+  }
+}
+
+TEST_CASE("Limits", "[gizmesh]") {
+  using gizmesh::GizmoSystem;
+  falg::float3 eye{0, 2, 8};
+  falg::float4 r{0, 0, 0, 1};
+  falg::float3 t{1, 0, 0};
+  auto frame = [&](GizmoSystem &system) {
+    system.begin(eye, r, eye, {0, 0, -1}, false);
+    gizmesh::handle::translation(system, 1, true, nullptr, t, r);
+    return system.end();
+  };
+
+  GizmoSystem fixed({8, 40, 3000, 9000});
+  for (int f = 0; f < 2; ++f) {
+    auto buffer = frame(fixed);
+    REQUIRE(buffer.overflow == 0);
+    REQUIRE(buffer.commandCount > 0);
+  }
+
+  // twice the bytes of the built-in vertex, half the vertices fit. the
+  // gizmo has fewer than 300 vertices but more than 150
+  struct wide_writer {
+    struct vertex {
+      float values[20];
+    };
+    static void write(vertex &v, const std::array<float, 3> &position,
+                      const std::array<float, 3> &,
+                      const std::array<float, 4> &) {
+      v.values[0] = position[0];
+    }
+  };
+  GizmoSystem wide({8, 40, 300, 9000});
+  for (int f = 0; f < 2; ++f) {
+    wide.begin(eye, r, eye, {0, 0, -1}, false);
+    gizmesh::handle::translation(wide, 1, true, nullptr, t, r);
+    auto buffer = wide.end<wide_writer>();
+    REQUIRE(buffer.overflow == GizmoSystem::OverflowVertices);
+    REQUIRE(buffer.verticesBytes > 0);
+    REQUIRE(buffer.verticesBytes <= 300 * 40);
+  }
+
+  // the scratch of end() does not fit, the frame is dropped
+  GizmoSystem tiny({8, 40, 3000, 9000, 16});
+  for (int f = 0; f < 2; ++f) {
+    auto buffer = frame(tiny);
+    REQUIRE(buffer.overflow == GizmoSystem::OverflowArena);
+    REQUIRE(buffer.commandCount == 0);
+    REQUIRE(buffer.verticesBytes == 0);
+  }
+}
+
+TEST_CASE("Hover", "[gizmesh]") {
+  using gizmesh::GizmoSystem;
+  GizmoSystem system(GizmoSystem::OutputMode::Instanced);
+  falg::float3 eye{0, 0, 8};
+  falg::float4 r{0, 0, 0, 1};
+  for (int handle = 0; handle < 3; ++handle) {
+    // the ray passes the x axis of the gizmo at the origin
+    uint32_t hovered = 0;
+    bool hover = false;
+    for (int f = 0; f < 3; ++f) {
+      system.begin(eye, r, {0.7f, 0, 8}, {0, 0, -1}, false);
+      falg::float3 t{0, 0, 0};
+      falg::float3 s{1, 1, 1};
+      auto id = 10 + handle;
+      if (handle == 0) {
+        hover = gizmesh::handle::translation(system, id, true, nullptr, t, r);
+      } else if (handle == 1) {
+        hover = gizmesh::handle::rotation(system, id, true, nullptr, t, r);
+      } else {
+        hover = gizmesh::handle::scale(system, id, false, t, r, s);
+      }
+      auto buffer = system.end();
+      auto instances =
+          reinterpret_cast<const GizmoSystem::Instance *>(buffer.pInstances);
+      auto count = buffer.instancesBytes / sizeof(GizmoSystem::Instance);
+      REQUIRE(count > 1);
+      hovered = 0;
+      for (size_t i = 0; i < count; ++i) {
+        if (instances[i].flags & GizmoSystem::InstanceHover) {
+          ++hovered;
+        }
+      }
+    }
+    // only the component under the ray
+    REQUIRE(hover);
+    REQUIRE(hovered == 1);
+  }
+}
+
+TEST_CASE("TranslucentFirstIndex", "[gizmesh]") {
+  using gizmesh::GizmoSystem;
+  GizmoSystem system;
+  falg::float3 eye{0, 0, 8};
+  falg::float4 r{0, 0, 0, 1};
+  GizmoSystem::View view{1.0f, 1080, {}};
+  uint32_t lod = 0;
+  uint32_t translucentFirstIndex = 0;
+  for (int f = 0; f < 2; ++f) {
+    system.begin(eye, r, eye, {0, 1, 0}, false, view);
+    // the translucent planes do not change
+    falg::float3 still{0, 0, 0};
+    gizmesh::handle::translation(system, 1, true, nullptr, still, r);
+    // an opaque gizmo after it switches its level of detail
+    falg::float3 t{0, 0, f ? -400.0f : 0.0f};
+    falg::float3 s{1, 1, 1};
+    gizmesh::handle::scale(system, 2, false, t, r, s);
+    auto buffer = system.end();
+
+    bool translucent = false;
+    for (uint32_t i = 0; i < buffer.commandCount; ++i) {
+      auto &command = buffer.pCommands[i];
+      if (command.blend == GizmoSystem::Blend::Translucent) {
+        translucent = true;
+        REQUIRE(command.firstIndex == buffer.translucentFirstIndex);
+      }
+      if (command.gizmo == 2) {
+        lod = command.lod;
+      }
+    }
+    REQUIRE(translucent);
+    if (f) {
+      REQUIRE(lod > 0);
+      REQUIRE(buffer.translucentFirstIndex != translucentFirstIndex);
+    }
+    translucentFirstIndex = buffer.translucentFirstIndex;
+  }
+}
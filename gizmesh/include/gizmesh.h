@@ -1,22 +1,262 @@
 #pragma once
 #include <array>
+#include <memory_resource>
 #include <stdint.h>
+#include <string.h>
 #include <string>
 
 namespace gizmesh {
 
+// Built-in gizmo parts. Index of GizmoSystem::Atlas::pComponents
+enum class GizmoComponentId : uint32_t {
+  TranslationX,
+  TranslationY,
+  TranslationZ,
+  TranslationXY,
+  TranslationYZ,
+  TranslationZX,
+  TranslationXYZ,
+  RotationX,
+  RotationY,
+  RotationZ,
+  // arrow of the global rotation drag
+  RotationArrow,
+  ScaleX,
+  ScaleY,
+  ScaleZ,
+  Count,
+};
+
+///
+/// Runs the data-parallel stages of a GizmoSystem, see set_scheduler.
+///
+/// Implement it on top of the scheduler of the application so gizmesh does
+/// not start threads of its own. A job is a function pointer and a context,
+/// nothing is allocated per job.
+///
+struct JobScheduler {
+  // processes [begin, end) of a parallel_for, or the range given to submit()
+  using JobFunction = void (*)(void *context, uint32_t begin, uint32_t end);
+
+  virtual ~JobScheduler() = default;
+  // run function(context, begin, end) now or later, on any thread
+  virtual void submit(JobFunction function, void *context, uint32_t begin,
+                      uint32_t end) = 0;
+  // returns when all submitted jobs are done
+  virtual void wait() = 0;
+  // [0, count) in ranges of grain items. returns when all are done
+  virtual void parallel_for(JobFunction function, void *context,
+                            uint32_t count, uint32_t grain);
+};
+
+// runs every job on the calling thread, in submit()
+struct SerialJobScheduler : JobScheduler {
+  void submit(JobFunction function, void *context, uint32_t begin,
+              uint32_t end) override;
+  void wait() override {}
+  void parallel_for(JobFunction function, void *context, uint32_t count,
+                    uint32_t grain) override;
+};
+
+///
+/// A fixed set of worker threads for standalone use.
+///
+/// Each worker has its own queue, pops its newest job and steals the oldest
+/// job of another worker when empty. The queues are fixed rings, a job
+/// submitted to a full queue runs on the submitting thread. wait() runs jobs
+/// on the calling thread until all are done.
+///
+struct WorkStealingJobScheduler : JobScheduler {
+  struct job_pool_impl *m_impl = nullptr;
+
+  // 0: one less than the hardware threads
+  WorkStealingJobScheduler(uint32_t threadCount = 0);
+  ~WorkStealingJobScheduler();
+  WorkStealingJobScheduler(const WorkStealingJobScheduler &) = delete;
+  WorkStealingJobScheduler &
+  operator=(const WorkStealingJobScheduler &) = delete;
+
+  uint32_t thread_count() const;
+  void submit(JobFunction function, void *context, uint32_t begin,
+              uint32_t end) override;
+  void wait() override;
+};
+
 struct GizmoSystem {
   struct gizmo_system_impl *m_impl = nullptr;
 
-  GizmoSystem();
+  enum class OutputMode {
+    // end() returns world space vertices of all gizmos
+    Mesh,
+    // end() returns one Instance per drawn component. geometry is atlas()
+    Instanced,
+  };
+
+  // Caps of a GizmoSystem. 0 is unlimited.
+  // When all are set, every allocation is done in the constructor (and
+  // set_triple_buffered) and a frame over the caps drops gizmos and geometry
+  // instead of allocating. set_concurrent is not covered, see there.
+  // See Buffer::overflow
+  struct Limits {
+    uint32_t maxGizmos;
+    // components drawn in a frame
+    uint32_t maxDraws;
+    // of the built-in vertex formats. An encoder with a wider stride gets as
+    // many vertices as fit in the same bytes
+    uint32_t maxVertices;
+    uint32_t maxIndices;
+    // of the frame arena for the scratch of end(). 0: enough for the caps
+    // above, else a frame whose scratch does not fit is dropped
+    size_t maxScratchBytes = 0;
+  };
+
+  // resource: long-lived state and the block of the per-frame arena
+  GizmoSystem(OutputMode mode = OutputMode::Mesh,
+              std::pmr::memory_resource *resource =
+                  std::pmr::get_default_resource());
+  GizmoSystem(const Limits &limits, OutputMode mode = OutputMode::Mesh,
+              std::pmr::memory_resource *resource =
+                  std::pmr::get_default_resource());
   ~GizmoSystem();
 
-  // Clear geometry buffer and update internal `GizmoFrameState` data
+  // Clear geometry buffer and update internal `GizmoFrameState` data.
+  // Resets the per-frame arena, the last Buffer becomes invalid
   void begin(const std::array<float, 3> &camera_position,
              const std::array<float, 4> &camera_rotation,
              const std::array<float, 3> &ray_origin,
              const std::array<float, 3> &ray_direction, bool button);
 
+  // Perspective of the camera. The built-in components have several levels of
+  // detail and each gizmo draws the coarsest one that is within a pixel of the
+  // finest at its distance to camera_position. Without a View all gizmos are
+  // drawn at the finest level
+  struct View {
+    float fovYRadians;
+    // pixels
+    float viewportHeight;
+    // row vector, row major. A gizmo outside is neither picked nor drawn, but
+    // a drag goes on. A component outside is not drawn. All zero culls nothing
+    std::array<float, 16> viewProjection;
+  };
+  void begin(const std::array<float, 3> &camera_position,
+             const std::array<float, 4> &camera_rotation,
+             const std::array<float, 3> &ray_origin,
+             const std::array<float, 3> &ray_direction, bool button,
+             const View &view);
+
+  enum class PositionFormat : uint32_t {
+    Float3,
+    // IEEE half x, y, z, 1
+    Half4,
+  };
+  enum class NormalFormat : uint32_t {
+    Float3,
+    // x, y, z, 0 in [-127, 127]
+    Snorm8x4,
+    // octahedral encoded, two snorm16
+    Oct16x2,
+    // no normal attribute, for unlit rendering
+    None,
+  };
+  enum class ColorFormat : uint32_t {
+    Float4,
+    Unorm8x4,
+    // uint8 index into Buffer::pPalette, then 3 bytes padding
+    Palette8,
+  };
+  enum class IndexFormat : uint32_t {
+    UInt32,
+    // a frame is capped to 65536 vertices
+    UInt16,
+  };
+  struct Format {
+    PositionFormat position = PositionFormat::Float3;
+    NormalFormat normal = NormalFormat::Float3;
+    ColorFormat color = ColorFormat::Float4;
+    IndexFormat index = IndexFormat::UInt32;
+  };
+  // Layout of the Buffer vertices and indices, from the next end()
+  void set_format(const Format &format);
+
+  enum class Primitive : uint32_t {
+    Triangles,
+    // an outline of each component: axis lines, arrowhead and box edges, ring
+    // circles. Far fewer vertices, unlit with zero normals. Buffer::pIndices
+    // is empty and the lines are in Buffer::pLineIndices. With
+    // Picking::Geometry handles pick within a few pixels of a line
+    Lines,
+  };
+  // What end() emits and handles pick. Call between end() and begin()
+  void set_primitive(Primitive primitive);
+
+  enum class Picking : uint32_t {
+    // an analytic shape per component: capsules and cones of the arrows and
+    // maces, tori of the rings, boxes of the planes
+    Proxies,
+    // the drawn triangles or lines of the Primitive
+    Geometry,
+  };
+  // How handles pick. With a View the proxies are grown by tolerancePixels at
+  // the distance of the gizmo. Call between end() and begin()
+  void set_picking(Picking picking, float tolerancePixels = 2);
+
+  // Arbitrates picking between gizmos. Each visible gizmo registers its
+  // bounds, and end() finds the nearest hit along the ray through a BVH over
+  // all of them. Only that gizmo picks in the next frame, so exactly one
+  // hovers or starts a drag on a click, a frame after the ray reached it.
+  // Call between end() and begin()
+  void set_arbitration(bool enable);
+
+  enum OverflowFlags : uint32_t {
+    // a handle with a new id was ignored
+    OverflowGizmos = 1,
+    OverflowDraws = 2,
+    OverflowVertices = 4,
+    OverflowIndices = 8,
+    // the scratch of end() did not fit Limits::maxScratchBytes, nothing was
+    // drawn
+    OverflowArena = 16,
+  };
+
+  enum class Blend : uint32_t {
+    Opaque,
+    // alpha < 1. the plane and center handles
+    Translucent,
+  };
+  // A drawn component.
+  // OutputMode::Mesh: a range of Buffer indices, which are absolute. A
+  // translucent component has no range, see Buffer::translucentFirstIndex.
+  // Primitive::Lines: a range of Buffer::pLineIndices, translucent too.
+  // OutputMode::Instanced: the atlas range of pInstances[instance].
+  struct Command {
+    uint32_t gizmo;
+    // GizmoComponentId
+    uint32_t component;
+    // level of detail, 0 is the finest. see Atlas::pLods
+    uint32_t lod;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t baseVertex;
+    uint32_t vertexCount;
+    uint32_t instance;
+    Blend blend;
+    // InstanceFlags
+    uint32_t flags;
+    // world space
+    std::array<float, 3> aabbMin;
+    std::array<float, 3> aabbMax;
+  };
+
+  // bytes of a buffer
+  struct Range {
+    uint32_t offset;
+    uint32_t bytes;
+  };
+
+  // Buffers are kept across frames. Only the components that changed since
+  // the previous end() are written, see pDirty*.
+  // Triple buffered, the changes are relative to the previous Buffer of the
+  // same slot.
   struct Buffer {
     uint8_t *pVertices;
     uint32_t verticesBytes;
@@ -24,8 +264,208 @@ struct GizmoSystem {
     uint8_t *pIndices;
     uint32_t indicesBytes;
     uint32_t indexStride;
+    // OutputMode::Mesh. The indices of opaque components come first. From
+    // translucentFirstIndex on are the triangles of all translucent components,
+    // sorted back to front from camera_position. Draw the first range without
+    // blending, then the translucent range in one blended draw
+    uint32_t translucentFirstIndex;
+    uint32_t translucentIndexCount;
+    // OutputMode::Mesh and Primitive::Lines. A line list with indexStride,
+    // pDirtyIndices are of it. Translucent lines are not sorted
+    uint8_t *pLineIndices;
+    uint32_t lineIndicesBytes;
+    // OutputMode::Instanced
+    uint8_t *pInstances;
+    uint32_t instancesBytes;
+    uint32_t instanceStride;
+    // OverflowFlags. what was dropped in this frame
+    uint32_t overflow;
+    // attribute layout. offsets are in bytes, ~0u for an absent attribute
+    Format format;
+    uint32_t positionOffset;
+    uint32_t normalOffset;
+    uint32_t colorOffset;
+    // ColorFormat::Palette8
+    const std::array<float, 4> *pPalette;
+    uint32_t paletteCount;
+    // one Command per drawn component, in draw order
+    const Command *pCommands;
+    uint32_t commandCount;
+    // written by this end(), for partial uploads. a buffer that shrinks
+    // has no dirty range for the dropped tail
+    const Range *pDirtyVertices;
+    uint32_t dirtyVertexCount;
+    const Range *pDirtyIndices;
+    uint32_t dirtyIndexCount;
+    const Range *pDirtyInstances;
+    uint32_t dirtyInstanceCount;
+    // 0, or 0 to 2 when triple buffered. keep a GPU buffer per slot
+    uint32_t slot;
   };
+  // Triple buffered, the frame is also published for acquire() and stays
+  // valid until the next end()
   Buffer end();
+
+  // World space vertices of a component, count of each array. normal is
+  // transformed even for NormalFormat::None
+  struct VertexBlock {
+    const float *position[3];
+    const float *normal[3];
+    std::array<float, 4> color;
+    uint32_t count;
+  };
+  // Writes VertexBlocks in a vertex type of the application. A block is
+  // written once and may be written by several jobs at a time
+  struct VertexEncoder {
+    uint32_t stride;
+    void (*encode)(const VertexBlock &block, uint8_t *dst);
+  };
+  // OutputMode::Mesh writes Buffer::pVertices with encoder instead of
+  // set_format. The index format still applies, the attribute offsets are ~0u
+  Buffer end(const VertexEncoder &encoder);
+
+  // end() into VertexWriter::vertex, which is trivially copyable:
+  //
+  // struct VertexWriter {
+  //   using vertex = MyVertex;
+  //   static void write(MyVertex &v, const std::array<float, 3> &position,
+  //                     const std::array<float, 3> &normal,
+  //                     const std::array<float, 4> &color);
+  // };
+  //
+  // write is inlined into the loop over a block
+  template <typename VertexWriter> Buffer end() {
+    return end(encoder<VertexWriter>());
+  }
+
+  // Memory that OutputMode::Mesh geometry is streamed to, such as mapped GPU
+  // buffers, instead of Buffer::pVertices and pIndices, which are nullptr.
+  // Such an end() writes all vertices and indices, so a buffer mapped with
+  // discard is filled whole. OutputMode::Instanced does not stream
+  struct OutputStream {
+    virtual ~OutputStream() = default;
+    // The sizes of this frame, before any chunk. Called by every end() with
+    // the stream, even with no geometry. The indices are the line list of
+    // Primitive::Lines. false writes nothing, see Buffer::overflow
+    virtual bool reserve(uint32_t verticesBytes, uint32_t vertexStride,
+                         uint32_t indicesBytes, uint32_t indexStride) = 0;
+    // Writable memory for bytes at offset, a component at a time. Jobs of
+    // the JobScheduler call these at the same time for disjoint ranges
+    virtual uint8_t *vertices(uint32_t offset, uint32_t bytes) = 0;
+    virtual uint8_t *indices(uint32_t offset, uint32_t bytes) = 0;
+  };
+  Buffer end(OutputStream &stream);
+  Buffer end(const VertexEncoder &encoder, OutputStream &stream);
+  template <typename VertexWriter> Buffer end(OutputStream &stream) {
+    return end(encoder<VertexWriter>(), stream);
+  }
+
+  template <typename VertexWriter> static VertexEncoder encoder() {
+    return {static_cast<uint32_t>(sizeof(typename VertexWriter::vertex)),
+            &encode_block<VertexWriter>};
+  }
+
+  template <typename VertexWriter>
+  static void encode_block(const VertexBlock &block, uint8_t *dst) {
+    auto &p = block.position;
+    auto &n = block.normal;
+    for (uint32_t i = 0; i < block.count; ++i) {
+      // dst is not aligned for the vertex
+      typename VertexWriter::vertex v;
+      VertexWriter::write(v, {p[0][i], p[1][i], p[2][i]},
+                          {n[0][i], n[1][i], n[2][i]}, block.color);
+      memcpy(dst, &v, sizeof(v));
+      dst += sizeof(v);
+    }
+  }
+
+  // Output to a render thread that reads frame N while frame N+1 is built.
+  // end() publishes into one of three Buffers and acquire() takes the latest
+  // published one. Neither side locks or waits, a frame not acquired before
+  // the next end() is skipped.
+  // Call before the first begin()
+  void set_triple_buffered(bool enable);
+  // Render thread. false if nothing was published since the last acquire().
+  // The Buffer is valid until the next acquire()
+  bool acquire(Buffer *buffer);
+  // Render thread. The acquired Buffer was uploaded, so the next frame in its
+  // slot reports only the changes. Without release() the slot is rewritten
+  // whole
+  void release();
+
+  // Handles may be called from several threads between begin() and end().
+  // Each thread draws into its own list and the gizmos are split into locked
+  // shards. end() merges the lists ordered by gizmo id, so the output is the
+  // same whichever thread ran a handle. A gizmo id is handled by one thread
+  // per frame. Threads get their state on first use, from a resource that
+  // must be thread-safe. The shards and the thread states grow on demand,
+  // so a concurrent GizmoSystem allocates even with all Limits set.
+  // Call before the first begin(), all gizmo state is dropped
+  void set_concurrent(bool enable);
+
+  // Runs the vertex emission of end(). nullptr is a SerialJobScheduler.
+  // The scheduler must outlive the GizmoSystem
+  void set_scheduler(JobScheduler *scheduler);
+
+  enum InstanceFlags : uint32_t {
+    InstanceActive = 1,
+    InstanceHover = 2,
+  };
+  struct Instance {
+    // GizmoComponentId
+    uint32_t component;
+    // InstanceFlags
+    uint32_t flags;
+    // local to world. row vector, row major
+    std::array<float, 16> matrix;
+    std::array<float, 4> color;
+  };
+
+  // A built-in component mesh before and after the optimization at creation:
+  // seams are welded, then triangles and vertices are reordered for the
+  // vertex caches. acmr is vertices transformed per triangle with a 16 entry
+  // FIFO cache
+  struct MeshStats {
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    float acmr;
+    uint32_t sourceVertexCount;
+    uint32_t sourceTriangleCount;
+    float sourceAcmr;
+  };
+  struct AtlasRange {
+    uint32_t baseVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+  };
+  // Immutable local space geometry of all built-in components and levels of
+  // detail. pComponents is the finest level. Indices are relative to
+  // AtlasRange::baseVertex.
+  struct Atlas {
+    const uint8_t *pVertices;
+    uint32_t verticesBytes;
+    uint32_t vertexStride;
+    const uint8_t *pIndices;
+    uint32_t indicesBytes;
+    uint32_t indexStride;
+    // indexed by GizmoComponentId
+    const AtlasRange *pComponents;
+    uint32_t componentCount;
+    // indexed by GizmoComponentId, of the finest level
+    const MeshStats *pStats;
+    // level l of a component is pLods[component * lodCount + l].
+    // a component with fewer levels repeats its coarsest
+    const AtlasRange *pLods;
+    uint32_t lodCount;
+    // Primitive::Lines. The outlines are in pVertices, their line lists in
+    // pLineIndices with indexStride
+    const uint8_t *pLineIndices;
+    uint32_t lineIndicesBytes;
+    // indexed by GizmoComponentId
+    const AtlasRange *pLines;
+  };
+  static Atlas atlas();
 };
 
 // 32 bit FNV Hash
@@ -0,0 +1,93 @@
+#pragma once
+#include <algorithm>
+#include <memory_resource>
+#include <optional>
+
+namespace gizmesh {
+
+///
+/// monotonic allocator for data that lives one frame.
+///
+/// reset() releases everything at once. The block is taken from upstream and
+/// grows to the peak usage of the previous frames, so a steady frame does not
+/// touch upstream.
+/// A fixed arena never grows. Running out of it throws std::bad_alloc with
+/// exhausted() set.
+///
+class frame_arena : public std::pmr::memory_resource {
+  std::pmr::memory_resource *m_upstream;
+  void *m_block = nullptr;
+  size_t m_capacity = 0;
+  size_t m_used = 0;
+  bool m_fixed = false;
+  bool m_exhausted = false;
+  std::optional<std::pmr::monotonic_buffer_resource> m_monotonic;
+
+public:
+  frame_arena(std::pmr::memory_resource *upstream, size_t capacity = 4096,
+              bool fixed = false)
+      : m_upstream(upstream), m_fixed(fixed) {
+    grow(capacity);
+  }
+
+  ~frame_arena() {
+    m_monotonic.reset();
+    m_upstream->deallocate(m_block, m_capacity);
+  }
+
+  frame_arena(const frame_arena &) = delete;
+  frame_arena &operator=(const frame_arena &) = delete;
+
+  std::pmr::memory_resource *upstream() const { return m_upstream; }
+  size_t capacity() const { return m_capacity; }
+  size_t used() const { return m_used; }
+  // a fixed arena ran out since the last reset()
+  bool exhausted() const { return m_exhausted; }
+
+  // all memory allocated from this arena becomes invalid
+  void reset() {
+    if (m_used > m_capacity && !m_fixed) {
+      size_t capacity = m_capacity;
+      while (capacity < m_used) {
+        capacity *= 2;
+      }
+      grow(capacity);
+    } else {
+      m_monotonic->release();
+    }
+    m_used = 0;
+    m_exhausted = false;
+  }
+
+private:
+  void grow(size_t capacity) {
+    m_monotonic.reset();
+    if (m_block) {
+      m_upstream->deallocate(m_block, m_capacity);
+    }
+    m_capacity = std::max(capacity, size_t(64));
+    m_block = m_upstream->allocate(m_capacity);
+    m_monotonic.emplace(m_block, m_capacity,
+                        m_fixed ? std::pmr::null_memory_resource()
+                                : m_upstream);
+  }
+
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    m_used += bytes + alignment;
+    try {
+      return m_monotonic->allocate(bytes, alignment);
+    } catch (const std::bad_alloc &) {
+      m_exhausted = m_fixed;
+      throw;
+    }
+  }
+
+  void do_deallocate(void *, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+} // namespace gizmesh
@@ -153,6 +153,97 @@ geometry_mesh geometry_mesh::make_lathed_geometry(
   return mesh;
 }
 
+std::vector<geometry_lod> geometry_mesh::make_lathed_lods(
+    const falg::float3 &axis, const falg::float3 &arm1,
+    const falg::float3 &arm2, int slices, uint32_t lodCount,
+    const falg::float2 *points, uint32_t pointCount, const float eps) {
+  float radius = 0;
+  for (uint32_t j = 0; j < pointCount; ++j) {
+    radius = std::max(radius, std::abs(points[j][1]));
+  }
+
+  std::vector<geometry_lod> lods;
+  for (int s = slices; lods.size() < lodCount && s >= 3; s /= 2) {
+    // the middle of a chord is the furthest point from the circle.
+    // the finest level is off by its own chords already
+    auto error = radius * (std::cos(tau / 2 / slices) - std::cos(tau / 2 / s));
+    lods.push_back(
+        {make_lathed_geometry(axis, arm1, arm2, s, points, pointCount, eps),
+         error});
+  }
+  return lods;
+}
+
+void geometry_lines::add_segment(const falg::float3 &a,
+                                 const falg::float3 &b) {
+  auto base = static_cast<uint32_t>(points.size());
+  points.push_back(a);
+  points.push_back(b);
+  lines.push_back(base);
+  lines.push_back(base + 1);
+}
+
+void geometry_lines::add_circle(const falg::float3 &center,
+                                const falg::float3 &arm1,
+                                const falg::float3 &arm2, uint32_t slices) {
+  auto base = static_cast<uint32_t>(points.size());
+  for (uint32_t i = 0; i < slices; ++i) {
+    // the angles of make_lathed_geometry
+    const float angle = static_cast<float>(i) * tau / slices + (tau / 8.f);
+    points.push_back(center + arm1 * std::cos(angle) + arm2 * std::sin(angle));
+    lines.push_back(base + i);
+    lines.push_back(base + (i + 1) % slices);
+  }
+}
+
+void geometry_lines::add_cone(const falg::float3 &base, const falg::float3 &tip,
+                              const falg::float3 &arm1,
+                              const falg::float3 &arm2, uint32_t slices,
+                              uint32_t spokes) {
+  auto first = static_cast<uint32_t>(points.size());
+  add_circle(base, arm1, arm2, slices);
+  auto apex = static_cast<uint32_t>(points.size());
+  points.push_back(tip);
+  for (uint32_t i = 0; i < spokes; ++i) {
+    lines.push_back(first + i * slices / spokes);
+    lines.push_back(apex);
+  }
+}
+
+void geometry_lines::add_box(const falg::float3 &axis,
+                             const falg::float3 &arm1,
+                             const falg::float3 &arm2, const falg::float3 &min,
+                             const falg::float3 &max) {
+  auto base = static_cast<uint32_t>(points.size());
+  // corner i has bit 0: axis, bit 1: arm1, bit 2: arm2 at max
+  for (uint32_t i = 0; i < 8; ++i) {
+    points.push_back(axis * (i & 1 ? max[0] : min[0]) +
+                     arm1 * (i & 2 ? max[1] : min[1]) +
+                     arm2 * (i & 4 ? max[2] : min[2]));
+  }
+  for (uint32_t i = 0; i < 8; ++i) {
+    for (uint32_t bit = 1; bit < 8; bit <<= 1) {
+      if (!(i & bit)) {
+        lines.push_back(base + i);
+        lines.push_back(base + (i | bit));
+      }
+    }
+  }
+}
+
+float geometry_lines::raycast(const falg::Ray &ray, float radius) const {
+  float best = std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i + 1 < lines.size(); i += 2) {
+    float t;
+    auto distance =
+        falg::Distance(ray, {points[lines[i]], points[lines[i + 1]]}, &t);
+    if (distance <= radius && t < best) {
+      best = t;
+    }
+  }
+  return best;
+}
+
 float operator>>(const falg::Ray &ray, const geometry_mesh &mesh) {
   float best_t = std::numeric_limits<float>::infinity();
   for (auto it = mesh.triangles.begin(); it != mesh.triangles.end(); it += 3) {
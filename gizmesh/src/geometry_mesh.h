@@ -5,6 +5,8 @@
 
 namespace gizmesh {
 
+struct geometry_lod;
+
 struct geometry_vertex {
   falg::float3 position;
   falg::float3 normal;
@@ -26,15 +28,78 @@ struct geometry_mesh {
                        const falg::float3 &arm2, int slices,
                        const falg::float2 *points, uint32_t pointCount,
                        const float eps = 0.0f);
+  // make_lathed_geometry with slices, slices / 2, ... lodCount levels
+  static std::vector<geometry_lod>
+  make_lathed_lods(const falg::float3 &axis, const falg::float3 &arm1,
+                   const falg::float3 &arm2, int slices, uint32_t lodCount,
+                   const falg::float2 *points, uint32_t pointCount,
+                   const float eps = 0.0f);
 
   void compute_normals();
 
+  // Optimization of a finished mesh. geometry_optimize.cpp
+  // merges vertices with the same position, normal and color. the seams of
+  // lathed meshes. drops the triangles that collapse
+  void weld(float epsilon = 1e-6f);
+  // triangle order for the post-transform vertex cache
+  void optimize_vertex_cache();
+  // vertices in order of first use by the triangles
+  void optimize_vertex_fetch();
+  // average cache miss ratio. vertices transformed per triangle with a FIFO
+  // post-transform cache
+  float acmr(uint32_t cacheSize = 16) const;
+
+  falg::AABB bounds() const {
+    falg::AABB aabb;
+    for (auto &v : vertices) {
+      aabb.Extend(v.position);
+    }
+    return aabb;
+  }
+
+  // for the ray queries of a finished mesh
+  falg::Bvh bvh() const {
+    return falg::Bvh(vertices.empty() ? nullptr : &vertices[0].position,
+                     sizeof(geometry_vertex), triangles.data(),
+                     triangles.size());
+  }
+
   void clear() {
     vertices.clear();
     triangles.clear();
   }
 };
 
+// A level of detail
+struct geometry_lod {
+  geometry_mesh mesh;
+  // largest distance of the surface to the surface of the finest level
+  float error;
+};
+
+// A line list, two indices per segment. For GizmoSystem::Primitive::Lines
+struct geometry_lines {
+  std::vector<falg::float3> points;
+  std::vector<uint32_t> lines;
+
+  void add_segment(const falg::float3 &a, const falg::float3 &b);
+  // slices segments around center, in the plane of arm1 and arm2
+  void add_circle(const falg::float3 &center, const falg::float3 &arm1,
+                  const falg::float3 &arm2, uint32_t slices);
+  // circle of the base and spokes to the tip
+  void add_cone(const falg::float3 &base, const falg::float3 &tip,
+                const falg::float3 &arm1, const falg::float3 &arm2,
+                uint32_t slices, uint32_t spokes);
+  // the 12 edges. min and max are coordinates of the basis axis, arm1, arm2
+  void add_box(const falg::float3 &axis, const falg::float3 &arm1,
+               const falg::float3 &arm2, const falg::float3 &min,
+               const falg::float3 &max);
+
+  // t of the nearest point of the ray within radius of a segment, infinity if
+  // there is none
+  float raycast(const falg::Ray &ray, float radius) const;
+};
+
 float operator>>(const falg::Ray &ray, const geometry_mesh &mesh);
 
 } // namespace gizmesh
@@ -0,0 +1,196 @@
+#include "geometry_mesh.h"
+#include <algorithm>
+#include <cmath>
+
+namespace gizmesh {
+
+void geometry_mesh::weld(float epsilon) {
+  static const float NORMAL_DOT = 0.999f;
+
+  std::vector<uint32_t> remap(vertices.size());
+  std::vector<geometry_vertex> welded;
+  for (uint32_t i = 0; i < vertices.size(); ++i) {
+    auto &v = vertices[i];
+    remap[i] = static_cast<uint32_t>(welded.size());
+    for (uint32_t j = 0; j < welded.size(); ++j) {
+      auto &w = welded[j];
+      if (falg::Length(v.position - w.position) <= epsilon &&
+          falg::Dot(v.normal, w.normal) >= NORMAL_DOT && v.color == w.color) {
+        remap[i] = j;
+        break;
+      }
+    }
+    if (remap[i] == welded.size()) {
+      welded.push_back(v);
+    }
+  }
+  vertices.swap(welded);
+
+  // a pole of a lathed mesh collapses to one vertex
+  std::vector<uint32_t> kept;
+  kept.reserve(triangles.size());
+  for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+    auto i0 = remap[triangles[t]];
+    auto i1 = remap[triangles[t + 1]];
+    auto i2 = remap[triangles[t + 2]];
+    if (i0 == i1 || i1 == i2 || i2 == i0) {
+      continue;
+    }
+    kept.push_back(i0);
+    kept.push_back(i1);
+    kept.push_back(i2);
+  }
+  triangles.swap(kept);
+}
+
+// Tom Forsyth, Linear-Speed Vertex Cache Optimisation.
+// scores a vertex by its position in a simulated LRU cache and the number of
+// triangles still using it, then adds the best triangle of the cached
+// vertices. The order is kept only if acmr() improves
+static const int CACHE_SIZE = 32;
+
+static float vertex_score(int cachePosition, uint32_t remaining) {
+  if (remaining == 0) {
+    return -1;
+  }
+  float score = 0;
+  if (cachePosition >= 3) {
+    auto s = 1 - static_cast<float>(cachePosition - 3) / (CACHE_SIZE - 3);
+    score = std::pow(s, 1.5f);
+  } else if (cachePosition >= 0) {
+    // the last triangle. not to be used right away
+    score = 0.75f;
+  }
+  return score + 2 / std::sqrt(static_cast<float>(remaining));
+}
+
+void geometry_mesh::optimize_vertex_cache() {
+  auto triangleCount = triangles.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // triangles of each vertex
+  std::vector<uint32_t> offsets(vertices.size() + 1);
+  for (auto i : triangles) {
+    ++offsets[i + 1];
+  }
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    offsets[i + 1] += offsets[i];
+  }
+  std::vector<uint32_t> adjacency(triangles.size());
+  std::vector<uint32_t> remaining(vertices.size());
+  for (size_t t = 0; t < triangles.size(); ++t) {
+    auto v = triangles[t];
+    adjacency[offsets[v] + remaining[v]++] = static_cast<uint32_t>(t / 3);
+  }
+
+  std::vector<int> cachePosition(vertices.size(), -1);
+  std::vector<float> score(vertices.size());
+  for (size_t v = 0; v < vertices.size(); ++v) {
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+  std::vector<bool> added(triangleCount);
+  auto triangle_score = [&](uint32_t t) {
+    return score[triangles[t * 3]] + score[triangles[t * 3 + 1]] +
+           score[triangles[t * 3 + 2]];
+  };
+
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> ordered;
+  ordered.reserve(triangles.size());
+  size_t scan = 0;
+  while (ordered.size() < triangles.size()) {
+    // best triangle of the cached vertices
+    uint32_t best = ~0u;
+    float bestScore = -1;
+    for (auto v : cache) {
+      for (auto i = offsets[v]; i < offsets[v + 1]; ++i) {
+        auto t = adjacency[i];
+        if (!added[t]) {
+          auto s = triangle_score(t);
+          if (s > bestScore) {
+            best = t;
+            bestScore = s;
+          }
+        }
+      }
+    }
+    if (best == ~0u) {
+      // cache has no triangle left. take the next one in order
+      while (added[scan]) {
+        ++scan;
+      }
+      best = static_cast<uint32_t>(scan);
+    }
+
+    added[best] = true;
+    std::vector<uint32_t> next;
+    for (int k = 0; k < 3; ++k) {
+      auto v = triangles[best * 3 + k];
+      ordered.push_back(v);
+      next.push_back(v);
+      --remaining[v];
+    }
+    for (auto v : cache) {
+      if (std::find(next.begin(), next.end(), v) == next.end()) {
+        next.push_back(v);
+      }
+    }
+    for (auto v : cache) {
+      cachePosition[v] = -1;
+    }
+    for (size_t i = 0; i < next.size(); ++i) {
+      auto v = next[i];
+      cachePosition[v] = i < CACHE_SIZE ? static_cast<int>(i) : -1;
+      score[v] = vertex_score(cachePosition[v], remaining[v]);
+    }
+    if (next.size() > CACHE_SIZE) {
+      next.resize(CACHE_SIZE);
+    }
+    cache.swap(next);
+  }
+
+  // a lathed mesh is generated ring by ring, which can be better already
+  auto before = acmr();
+  triangles.swap(ordered);
+  if (acmr() > before) {
+    triangles.swap(ordered);
+  }
+}
+
+void geometry_mesh::optimize_vertex_fetch() {
+  std::vector<uint32_t> remap(vertices.size(), ~0u);
+  std::vector<geometry_vertex> ordered;
+  ordered.reserve(vertices.size());
+  for (auto &i : triangles) {
+    if (remap[i] == ~0u) {
+      remap[i] = static_cast<uint32_t>(ordered.size());
+      ordered.push_back(vertices[i]);
+    }
+    i = remap[i];
+  }
+  // unreferenced vertices are dropped
+  vertices.swap(ordered);
+}
+
+float geometry_mesh::acmr(uint32_t cacheSize) const {
+  if (triangles.empty()) {
+    return 0;
+  }
+  std::vector<uint32_t> fifo;
+  uint32_t misses = 0;
+  for (auto i : triangles) {
+    if (std::find(fifo.begin(), fifo.end(), i) != fifo.end()) {
+      continue;
+    }
+    ++misses;
+    fifo.push_back(i);
+    if (fifo.size() > cacheSize) {
+      fifo.erase(fifo.begin());
+    }
+  }
+  return static_cast<float>(misses) / (triangles.size() / 3);
+}
+
+} // namespace gizmesh
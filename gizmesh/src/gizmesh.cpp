@@ -13,7 +13,13 @@
 
 namespace gizmesh {
 
-GizmoSystem::GizmoSystem() : m_impl(new gizmo_system_impl) {}
+GizmoSystem::GizmoSystem(OutputMode mode,
+                         std::pmr::memory_resource *resource)
+    : m_impl(new gizmo_system_impl(mode, resource)) {}
+
+GizmoSystem::GizmoSystem(const Limits &limits, OutputMode mode,
+                         std::pmr::memory_resource *resource)
+    : m_impl(new gizmo_system_impl(mode, resource, limits)) {}
 
 GizmoSystem::~GizmoSystem() { delete m_impl; }
 
@@ -26,15 +32,212 @@ void GizmoSystem::begin(const std::array<float, 3> &camera_position,
       {camera_position, camera_rotation, ray_origin, ray_direction, button});
 }
 
+void GizmoSystem::begin(const std::array<float, 3> &camera_position,
+                        const std::array<float, 4> &camera_rotation,
+                        const std::array<float, 3> &ray_origin,
+                        const std::array<float, 3> &ray_direction, bool button,
+                        const View &view) {
+  GizmoFrameState state{camera_position, camera_rotation, ray_origin,
+                        ray_direction, button};
+  // a unit at distance 1 covers viewportHeight / (2 tan(fovY / 2)) pixels
+  state.lod_scale = view.viewportHeight / (2 * std::tan(view.fovYRadians / 2));
+  state.frustum = falg::Frustum(view.viewProjection);
+  m_impl->update(state);
+}
+
+void GizmoSystem::set_format(const Format &format) {
+  m_impl->set_format(format);
+}
+
+void GizmoSystem::set_primitive(Primitive primitive) {
+  m_impl->set_primitive(primitive);
+}
+
+void GizmoSystem::set_picking(Picking picking, float tolerancePixels) {
+  m_impl->set_picking(picking, tolerancePixels);
+}
+
+void GizmoSystem::set_arbitration(bool enable) {
+  m_impl->set_arbitration(enable);
+}
+
+static GizmoSystem::Buffer to_buffer(const gizmo_output &r) {
+  auto &layout = r.layout;
+  // r.indices holds the primitive
+  auto lines = r.primitive == GizmoSystem::Primitive::Lines;
+  auto indices = r.streamed ? nullptr : (uint8_t *)r.indices.data();
+  auto indicesBytes = r.streamed ? r.streamedIndexBytes
+                                 : static_cast<uint32_t>(r.indices.size());
+  return {
+      r.streamed ? nullptr : (uint8_t *)r.vertices.data(),
+      r.streamed ? r.streamedVertexBytes
+                 : static_cast<uint32_t>(r.vertices.size()),
+      layout.stride,
+      lines ? nullptr : indices,
+      lines ? 0 : indicesBytes,
+      layout.indexStride,
+      r.translucentFirstIndex,
+      r.translucentIndexCount,
+      lines ? indices : nullptr,
+      lines ? indicesBytes : 0,
+      (uint8_t *)r.instances.data(),
+      static_cast<uint32_t>(r.instances.size() *
+                            sizeof(GizmoSystem::Instance)),
+      static_cast<uint32_t>(sizeof(GizmoSystem::Instance)),
+      r.overflow,
+      layout.format,
+      layout.positionOffset,
+      layout.normalOffset,
+      layout.colorOffset,
+      r.palette.data(),
+      static_cast<uint32_t>(r.palette.size()),
+      r.commands.data(),
+      static_cast<uint32_t>(r.commands.size()),
+      r.dirtyVertices.data(),
+      static_cast<uint32_t>(r.dirtyVertices.size()),
+      r.dirtyIndices.data(),
+      static_cast<uint32_t>(r.dirtyIndices.size()),
+      r.dirtyInstances.data(),
+      static_cast<uint32_t>(r.dirtyInstances.size()),
+      r.slot,
+  };
+}
+
 GizmoSystem::Buffer GizmoSystem::end() {
-  auto &r = m_impl->render();
+  auto buffer = to_buffer(m_impl->render(nullptr, nullptr));
+  m_impl->publish();
+  return buffer;
+}
+
+GizmoSystem::Buffer GizmoSystem::end(const VertexEncoder &encoder) {
+  auto buffer = to_buffer(m_impl->render(&encoder, nullptr));
+  m_impl->publish();
+  return buffer;
+}
+
+GizmoSystem::Buffer GizmoSystem::end(OutputStream &stream) {
+  auto buffer = to_buffer(m_impl->render(nullptr, &stream));
+  m_impl->publish();
+  return buffer;
+}
+
+GizmoSystem::Buffer GizmoSystem::end(const VertexEncoder &encoder,
+                                     OutputStream &stream) {
+  auto buffer = to_buffer(m_impl->render(&encoder, &stream));
+  m_impl->publish();
+  return buffer;
+}
+
+void GizmoSystem::set_concurrent(bool enable) {
+  m_impl->set_concurrent(enable);
+}
+
+void GizmoSystem::set_scheduler(JobScheduler *scheduler) {
+  m_impl->set_scheduler(scheduler);
+}
+
+void GizmoSystem::set_triple_buffered(bool enable) {
+  m_impl->set_triple_buffered(enable);
+}
+
+bool GizmoSystem::acquire(Buffer *buffer) {
+  auto r = m_impl->acquire();
+  if (!r) {
+    return false;
+  }
+  *buffer = to_buffer(*r);
+  return true;
+}
+
+void GizmoSystem::release() { m_impl->release(); }
+
+struct atlas_storage {
+  geometry_mesh mesh;
+  std::array<GizmoSystem::AtlasRange,
+             static_cast<size_t>(GizmoComponentId::Count)>
+      ranges{};
+  std::array<GizmoSystem::MeshStats,
+             static_cast<size_t>(GizmoComponentId::Count)>
+      stats{};
+  // component * lodCount + level
+  std::vector<GizmoSystem::AtlasRange> lods;
+  uint32_t lodCount = 0;
+  // the outlines, after the meshes in mesh.vertices
+  std::vector<uint32_t> lineIndices;
+  std::array<GizmoSystem::AtlasRange,
+             static_cast<size_t>(GizmoComponentId::Count)>
+      lines{};
+
+  atlas_storage() {
+    std::vector<const GizmoComponent *> components;
+    append_translation_components(components);
+    append_rotation_components(components);
+    append_scale_components(components);
+    assert(components.size() == ranges.size());
+
+    for (auto c : components) {
+      lodCount = std::max(lodCount, static_cast<uint32_t>(c->lods.size()));
+    }
+    lods.resize(ranges.size() * lodCount);
+    for (auto c : components) {
+      auto id = static_cast<size_t>(c->id);
+      stats[id] = c->lods.front().stats;
+      for (uint32_t l = 0; l < lodCount; ++l) {
+        auto &range = lods[id * lodCount + l];
+        if (l >= c->lods.size()) {
+          range = lods[id * lodCount + l - 1];
+          continue;
+        }
+        auto &lod = c->lods[l].mesh;
+        range.baseVertex = static_cast<uint32_t>(mesh.vertices.size());
+        range.vertexCount = static_cast<uint32_t>(lod.vertices.size());
+        range.firstIndex = static_cast<uint32_t>(mesh.triangles.size());
+        range.indexCount = static_cast<uint32_t>(lod.triangles.size());
+        for (auto v : lod.vertices) {
+          // multiplied by Instance::color
+          v.color = {1, 1, 1, 1};
+          mesh.vertices.push_back(v);
+        }
+        mesh.triangles.insert(mesh.triangles.end(), lod.triangles.begin(),
+                              lod.triangles.end());
+      }
+      ranges[id] = lods[id * lodCount];
+    }
+
+    for (auto c : components) {
+      auto &outline = c->outline.geometry;
+      auto &range = lines[static_cast<size_t>(c->id)];
+      range.baseVertex = static_cast<uint32_t>(mesh.vertices.size());
+      range.vertexCount = static_cast<uint32_t>(outline.points.size());
+      range.firstIndex = static_cast<uint32_t>(lineIndices.size());
+      range.indexCount = static_cast<uint32_t>(outline.lines.size());
+      for (auto &p : outline.points) {
+        mesh.vertices.push_back({p, {0, 0, 0}, {1, 1, 1, 1}});
+      }
+      lineIndices.insert(lineIndices.end(), outline.lines.begin(),
+                         outline.lines.end());
+    }
+  }
+};
+
+GizmoSystem::Atlas GizmoSystem::atlas() {
+  static atlas_storage s_atlas;
+  auto &m = s_atlas.mesh;
   return {
-      (uint8_t *)r.vertices.data(),
-      static_cast<uint32_t>(r.vertices.size() * sizeof(r.vertices[0])),
-      static_cast<uint32_t>(sizeof(r.vertices[0])),
-      (uint8_t *)r.triangles.data(),
-      static_cast<uint32_t>(r.triangles.size() * sizeof(r.triangles[0])),
-      static_cast<uint32_t>(sizeof(r.triangles[0])),
+      (const uint8_t *)m.vertices.data(),
+      static_cast<uint32_t>(m.vertices.size() * sizeof(m.vertices[0])),
+      static_cast<uint32_t>(sizeof(m.vertices[0])),
+      (const uint8_t *)m.triangles.data(),
+      static_cast<uint32_t>(m.triangles.size() * sizeof(m.triangles[0])),
+      static_cast<uint32_t>(sizeof(m.triangles[0])),
+      s_atlas.ranges.data(),
+      static_cast<uint32_t>(s_atlas.ranges.size()),
+      s_atlas.stats.data(),
+      s_atlas.lods.data(),
+      s_atlas.lodCount,
+      (const uint8_t *)s_atlas.lineIndices.data(),
+      static_cast<uint32_t>(s_atlas.lineIndices.size() * sizeof(uint32_t)),
+      s_atlas.lines.data(),
   };
 }
 
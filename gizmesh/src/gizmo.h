@@ -1,4 +1,7 @@
+#pragma once
 #include "geometry_mesh.h"
+#include "gizmesh.h"
+#include "vertex_kernel.h"
 #include <vector>
 
 namespace gizmesh {
@@ -10,25 +13,294 @@ struct GizmoState {
   falg::float3 axis;
 };
 
-struct GizmoComponent {
+// A level of detail of a GizmoComponent
+struct GizmoLod {
   geometry_mesh mesh;
+  // geometry_lod::error
+  float error;
+  // mesh.vertices for the vertex_kernel
+  soa_float3 positions;
+  soa_float3 normals;
+  // of each triangle, for the depth sort of translucent components
+  std::vector<falg::float3> centroids;
+  // mesh.triangles for raycast
+  falg::Bvh bvh;
+  // mesh before and after the optimization
+  GizmoSystem::MeshStats stats;
+
+  // the mesh is welded and reordered for the vertex cache
+  GizmoLod(const geometry_lod &source) : mesh(source.mesh), error(source.error) {
+    stats.sourceVertexCount =
+        static_cast<uint32_t>(source.mesh.vertices.size());
+    stats.sourceTriangleCount =
+        static_cast<uint32_t>(source.mesh.triangles.size() / 3);
+    stats.sourceAcmr = source.mesh.acmr();
+    mesh.weld();
+    mesh.optimize_vertex_cache();
+    mesh.optimize_vertex_fetch();
+    stats.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    stats.triangleCount = static_cast<uint32_t>(mesh.triangles.size() / 3);
+    stats.acmr = mesh.acmr();
+
+    positions = soa_float3(
+        mesh.vertices,
+        [](const geometry_vertex &v) -> auto &{ return v.position; });
+    normals = soa_float3(
+        mesh.vertices,
+        [](const geometry_vertex &v) -> auto &{ return v.normal; });
+    for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+      auto &v0 = mesh.vertices[mesh.triangles[i]].position;
+      auto &v1 = mesh.vertices[mesh.triangles[i + 1]].position;
+      auto &v2 = mesh.vertices[mesh.triangles[i + 2]].position;
+      centroids.push_back((v0 + v1 + v2) * (1.0f / 3));
+    }
+    bvh = mesh.bvh();
+  }
+};
+
+// The outline of a GizmoComponent for GizmoSystem::Primitive::Lines
+struct GizmoLines {
+  geometry_lines geometry;
+  // geometry.points for the vertex_kernel. the normals are zero, lines are
+  // unlit
+  soa_float3 positions;
+  soa_float3 normals;
+
+  GizmoLines(const geometry_lines &source) : geometry(source) {
+    static const falg::float3 zero{0, 0, 0};
+    positions = soa_float3(geometry.points,
+                           [](const falg::float3 &p) -> auto &{ return p; });
+    normals = soa_float3(geometry.points,
+                         [](const falg::float3 &) -> auto &{ return zero; });
+  }
+};
+
+// Analytic hit shapes of a GizmoComponent, in its local space. A few flops
+// each instead of a test per drawn triangle
+struct GizmoProxies {
+  std::vector<falg::Capsule> capsules;
+  std::vector<falg::Cone> cones;
+  std::vector<falg::Torus> tori;
+  std::vector<falg::AABB> boxes;
+
+  // t of a local ray on the shapes grown by grow units, infinity on a miss
+  float raycast(const falg::Ray &ray, float grow) const {
+    // the falg shapes take a unit direction
+    auto length = falg::Length(ray.direction);
+    falg::Ray unit{ray.origin, ray.direction * (1 / length)};
+    auto best = std::numeric_limits<float>::infinity();
+    for (auto capsule : capsules) {
+      capsule.radius += grow;
+      best = std::min(best, unit >> capsule);
+    }
+    for (auto cone : cones) {
+      cone.radius += grow;
+      best = std::min(best, unit >> cone);
+    }
+    for (auto torus : tori) {
+      torus.thickness += grow;
+      best = std::min(best, unit >> torus);
+    }
+    for (auto &box : boxes) {
+      best = std::min(best, unit >> box.Grow(grow));
+    }
+    return best / length;
+  }
+
+  // the shapes before they are grown
+  void extend(falg::AABB *aabb) const {
+    auto sphere = [aabb](const falg::float3 &center, float radius) {
+      aabb->Merge(falg::AABB{center, center}.Grow(radius));
+    };
+    for (auto &capsule : capsules) {
+      sphere(capsule.v0, capsule.radius);
+      sphere(capsule.v1, capsule.radius);
+    }
+    for (auto &cone : cones) {
+      sphere(cone.base, cone.radius);
+      sphere(cone.tip, cone.radius);
+    }
+    for (auto &torus : tori) {
+      sphere(torus.center, torus.radius + torus.thickness);
+    }
+    for (auto &box : boxes) {
+      aabb->Merge(box);
+    }
+  }
+};
+
+// how a handle picks its components in a frame
+struct GizmoPick {
+  // gizmo_system_impl::pixels_per_unit at the gizmo
+  float pixelsPerUnit;
+  // GizmoSystem::Primitive::Lines
+  bool lines;
+  // GizmoSystem::Picking::Proxies
+  bool proxies;
+  // the proxies are grown by this many pixels
+  float tolerancePixels;
+};
+
+struct GizmoComponent {
+  GizmoComponentId id;
+  // finest first
+  std::vector<GizmoLod> lods;
+  GizmoLines outline;
+  GizmoProxies proxies;
   falg::float4 base_color;
   falg::float4 highlight_color;
   falg::float3 axis;
+  // local bounds of the finest level. the coarser ones are inside
+  falg::AABB bounds;
+  falg::Sphere sphere;
+  // local bounds of what is picked: the mesh, the outline and the proxies
+  falg::AABB pick_bounds;
+  falg::Sphere pick_sphere;
+
+  // pixels a drawn level may be off the finest one
+  static constexpr float draw_tolerance = 1.0f;
+  // picking is finer, so a hit is never missed where the drawn level covers
+  static constexpr float pick_tolerance = 0.5f;
+  // an outline is picked within this many pixels of a line
+  static constexpr float line_pick_pixels = 4.0f;
+  // local units of line_pick_pixels without a GizmoSystem::View
+  static constexpr float line_pick_units = 0.05f;
+
+  GizmoComponent(GizmoComponentId id, const std::vector<geometry_lod> &sources,
+                 const geometry_lines &outline, const GizmoProxies &proxies,
+                 const falg::float4 &base_color,
+                 const falg::float4 &highlight_color, const falg::float3 &axis)
+      : id(id), lods(sources.begin(), sources.end()), outline(outline),
+        proxies(proxies), base_color(base_color),
+        highlight_color(highlight_color), axis(axis) {
+    bounds = lods.front().mesh.bounds();
+    sphere.center = bounds.Center();
+    for (auto &v : lods.front().mesh.vertices) {
+      sphere.radius =
+          std::max(sphere.radius, falg::Length(v.position - sphere.center));
+    }
+    pick_bounds = bounds;
+    for (auto &p : this->outline.geometry.points) {
+      pick_bounds.Extend(p);
+    }
+    this->proxies.extend(&pick_bounds);
+    pick_sphere = {pick_bounds.Center(), falg::Length(pick_bounds.Extent())};
+  }
+  // one level
+  GizmoComponent(GizmoComponentId id, const geometry_mesh &source,
+                 const geometry_lines &outline, const GizmoProxies &proxies,
+                 const falg::float4 &base_color,
+                 const falg::float4 &highlight_color, const falg::float3 &axis)
+      : GizmoComponent(id, std::vector<geometry_lod>{{source, 0}}, outline,
+                       proxies, base_color, highlight_color, axis) {}
+
+  // the coarsest level within tolerance pixels of the finest one, when a
+  // local unit covers pixelsPerUnit pixels
+  uint32_t select_lod(float pixelsPerUnit, float tolerance) const {
+    uint32_t lod = 0;
+    while (lod + 1 < lods.size() &&
+           lods[lod + 1].error * pixelsPerUnit <= tolerance) {
+      ++lod;
+    }
+    return lod;
+  }
+
+  const GizmoLod &pick_lod(float pixelsPerUnit) const {
+    return lods[select_lod(pixelsPerUnit, pick_tolerance)];
+  }
+
+  // local units a pick reaches past the picked shapes
+  static float pick_margin(const GizmoPick &pick) {
+    if (pick.proxies) {
+      // not grown without a GizmoSystem::View
+      return std::isinf(pick.pixelsPerUnit)
+                 ? 0
+                 : pick.tolerancePixels / pick.pixelsPerUnit;
+    }
+    if (pick.lines) {
+      return std::isinf(pick.pixelsPerUnit)
+                 ? line_pick_units
+                 : line_pick_pixels / pick.pixelsPerUnit;
+    }
+    return 0;
+  }
+
+  // t of a local ray on the component, infinity on a miss. inverse is of ray
+  float raycast(const falg::Ray &ray, const falg::InverseRay &inverse,
+                const GizmoPick &pick) const {
+    auto margin = pick_margin(pick);
+    if (std::isinf(pick_bounds.Grow(margin).Enter(inverse))) {
+      return std::numeric_limits<float>::infinity();
+    }
+    if (pick.proxies) {
+      return proxies.raycast(ray, margin);
+    }
+    if (pick.lines) {
+      return outline.geometry.raycast(ray, margin);
+    }
+    return ray >> pick_lod(pick.pixelsPerUnit).bvh;
+  }
 };
 
+// local bounds of a gizmo, centered at its origin. of the drawn components,
+// or of what is picked with &GizmoComponent::pick_sphere.
+// T is a range of GizmoComponent pointers
+template <typename T>
+falg::Sphere bounding_sphere(const T &components,
+                             falg::Sphere GizmoComponent::*member =
+                                 &GizmoComponent::sphere) {
+  falg::Sphere sphere{{0, 0, 0}};
+  for (const GizmoComponent *c : components) {
+    auto &s = c->*member;
+    sphere.radius =
+        std::max(sphere.radius, falg::Length(s.center) + s.radius);
+  }
+  return sphere;
+}
+
+// a pick_sphere or their bounding_sphere grown by the pick margin. a box
+// grows by sqrt(3) margin at its corners
+inline falg::Sphere grow_pick_sphere(const falg::Sphere &sphere,
+                                     const GizmoPick &pick) {
+  return sphere.Grow(GizmoComponent::pick_margin(pick) * 1.7321f);
+}
+
+// the nearest of components a local ray hits, and its t. sphere is their
+// bounding_sphere of pick_sphere. most rays miss it and test no component
+template <typename T>
+std::pair<const GizmoComponent *, float>
+raycast_components(const T &components, const falg::Sphere &sphere,
+                   const falg::Ray &ray, const GizmoPick &pick) {
+  const GizmoComponent *nearest = nullptr;
+  float best_t = std::numeric_limits<float>::infinity();
+  if (!grow_pick_sphere(sphere, pick).Intersects(ray)) {
+    return std::make_pair(nearest, best_t);
+  }
+  falg::InverseRay inverse(ray);
+  for (const GizmoComponent *c : components) {
+    auto t = c->raycast(ray, inverse, pick);
+    if (t < best_t) {
+      nearest = c;
+      best_t = t;
+    }
+  }
+  return std::make_pair(nearest, best_t);
+}
+
 class Gizmo {
 protected:
-  // Flag to indicate if the gizmo is being hovered
-  bool m_hover = false;
+  // Component under the ray, set by the raycast of the handle
+  const GizmoComponent *m_hovered = nullptr;
   // Currently active component
   const GizmoComponent *m_active = nullptr;
 
 public:
+  uint32_t m_id = 0;
   GizmoState m_state;
 
-  bool isHoverOrActive() const { return m_hover || m_active; }
-  void hover(bool enable) { m_hover = enable; }
+  bool isHoverOrActive() const { return m_hovered || m_active; }
+  const GizmoComponent *hovered() const { return m_hovered; }
+  void hover(const GizmoComponent *component) { m_hovered = component; }
   const GizmoComponent *active() const { return m_active; }
 
   void end() { m_active = nullptr; }
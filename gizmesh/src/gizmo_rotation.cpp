@@ -44,69 +44,110 @@ static falg::float2 ring_points[] = {
     {+0.025f, 1},    {-0.025f, 1},    {-0.025f, 1},    {-0.025f, 1.1f},
     {-0.025f, 1.1f}, {+0.025f, 1.1f}, {+0.025f, 1.1f}, {+0.025f, 1}};
 
+// the middle circle of ring_points
+static geometry_lines ring_lines(const falg::float3 &arm1,
+                                 const falg::float3 &arm2) {
+  geometry_lines lines;
+  lines.add_circle({0, 0, 0}, arm1 * 1.05f, arm2 * 1.05f, 32);
+  return lines;
+}
+
+// the tube circumscribes the 0.1 x 0.05 profile of ring_points. its inner
+// edge is a polygon of 32 slices, a little inside the circle. eps of
+// make_lathed_lods
+static GizmoProxies ring_proxies(const falg::float3 &axis, float eps = 0) {
+  GizmoProxies proxies;
+  proxies.tori.push_back({{eps, eps, eps}, axis, 1.05f, 0.061f});
+  return proxies;
+}
+
 static GizmoComponent componentX{
-    geometry_mesh::make_lathed_geometry({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 32,
-                                        ring_points, _countof(ring_points),
-                                        0.003f),
+    GizmoComponentId::RotationX,
+    geometry_mesh::make_lathed_lods({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 32, 3,
+                                    ring_points, _countof(ring_points), 0.003f),
+    ring_lines({0, 1, 0}, {0, 0, 1}),
+    ring_proxies({1, 0, 0}, 0.003f),
     {1, 0.5f, 0.5f, 1.f},
     {1, 0, 0, 1.f},
     {1, 0, 0},
 };
 static GizmoComponent componentY{
-    geometry_mesh::make_lathed_geometry({0, 1, 0}, {0, 0, 1}, {1, 0, 0}, 32,
-                                        ring_points, _countof(ring_points),
-                                        -0.003f),
+    GizmoComponentId::RotationY,
+    geometry_mesh::make_lathed_lods({0, 1, 0}, {0, 0, 1}, {1, 0, 0}, 32, 3,
+                                    ring_points, _countof(ring_points),
+                                    -0.003f),
+    ring_lines({0, 0, 1}, {1, 0, 0}),
+    ring_proxies({0, 1, 0}, -0.003f),
     {0.5f, 1, 0.5f, 1.f},
     {0, 1, 0, 1.f},
     {0, 1, 0},
 };
 static GizmoComponent componentZ{
-    geometry_mesh::make_lathed_geometry({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 32,
-                                        ring_points, _countof(ring_points)),
+    GizmoComponentId::RotationZ,
+    geometry_mesh::make_lathed_lods({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 32, 3,
+                                    ring_points, _countof(ring_points)),
+    ring_lines({1, 0, 0}, {0, 1, 0}),
+    ring_proxies({0, 0, 1}),
     {0.5f, 0.5f, 1, 1.f},
     {0, 0, 1, 1.f},
     {0, 0, 1},
 };
 
+// Arrow from the center of the gizmo, lathed around local Y.
+// draw_global_active orients it by the drag offset
+static falg::float2 arrow_points[] = {
+    {0.0f, 0.f}, {0.0f, 0.05f}, {0.8f, 0.05f}, {0.9f, 0.10f}, {1.0f, 0}};
+
+static geometry_lines arrow_lines() {
+  geometry_lines lines;
+  lines.add_segment({0, 0, 0}, {0, 0.9f, 0});
+  lines.add_cone({0, 0.9f, 0}, {0, 1, 0}, {0.1f, 0, 0}, {0, 0, 0.1f}, 8, 4);
+  return lines;
+}
+
+static GizmoProxies arrow_proxies() {
+  GizmoProxies proxies;
+  proxies.capsules.push_back({{0, 0, 0}, {0, 0.9f, 0}, 0.05f});
+  proxies.cones.push_back({{0, 0.9f, 0}, {0, 1, 0}, 0.1f});
+  return proxies;
+}
+
+static GizmoComponent componentArrow{
+    GizmoComponentId::RotationArrow,
+    geometry_mesh::make_lathed_lods({0, 1, 0}, {1, 0, 0}, {0, 0, 1}, 32, 3,
+                                    arrow_points, _countof(arrow_points)),
+    arrow_lines(),
+    arrow_proxies(),
+    {1, 1, 1, 1},
+    {1, 1, 1, 1},
+    {0, 1, 0},
+};
+
 static const GizmoComponent *orientation_components[] = {
     &componentX,
     &componentY,
     &componentZ,
 };
+static const falg::Sphere rotation_sphere = bounding_sphere(
+    std::initializer_list<const GizmoComponent *>{
+        &componentX, &componentY, &componentZ, &componentArrow});
+static const falg::Sphere rotation_pick_sphere =
+    bounding_sphere(orientation_components, &GizmoComponent::pick_sphere);
 
-inline std::pair<const GizmoComponent *, float> raycast(const falg::Ray &ray) {
-  const GizmoComponent *updated_state = nullptr;
-  float best_t = std::numeric_limits<float>::infinity();
-  for (auto c : orientation_components) {
-    auto t = ray >> c->mesh;
-    if (t < best_t) {
-      updated_state = c;
-      best_t = t;
-    }
-  }
-  return std::make_pair(updated_state, best_t);
+inline std::pair<const GizmoComponent *, float>
+raycast(const falg::Ray &ray, const GizmoPick &pick) {
+  return raycast_components(orientation_components, rotation_pick_sphere, ray,
+                            pick);
 }
 
-static void draw_global_active(std::vector<gizmo_renderable> &drawlist,
-                               const falg::Transform &gizmoTransform,
-                               const GizmoComponent *active,
-                               const GizmoState &state) {
-  // auto modelMatrix =
-  // falg::size_cast<minalg::float4x4>(gizmoTransform.matrix());
-
+static void draw_global_active(gizmo_system_impl *impl, const Gizmo &gizmo,
+                               const falg::Transform &gizmoTransform) {
+  auto active = gizmo.active();
+  auto &state = gizmo.m_state;
   // For non-local transformations, we only present one rotation ring
   // and draw an arrow from the center of the gizmo to indicate the degree of
   // rotation
-  gizmo_renderable r{
-      active->mesh,
-      active->base_color,
-  };
-  for (auto &v : r.mesh.vertices) {
-    v.position = gizmoTransform.ApplyPosition(
-        v.position); // transform local coordinates into worldspace
-    v.normal = gizmoTransform.ApplyDirection(v.normal);
-  }
-  drawlist.push_back(r);
+  impl->draw(gizmo, active, gizmoTransform, true);
 
   {
     // Create orthonormal basis for drawing the arrow
@@ -115,42 +156,32 @@ static void draw_global_active(std::vector<gizmo_renderable> &drawlist,
     auto xDir = falg::Normalize(falg::Cross(a, zDir));
     auto yDir = falg::Cross(zDir, xDir);
 
-    // Ad-hoc geometry
-    falg::float2 arrow_points[] = {
-        {0.0f, 0.f}, {0.0f, 0.05f}, {0.8f, 0.05f}, {0.9f, 0.10f}, {1.0f, 0}};
-    auto geo = geometry_mesh::make_lathed_geometry(
-        falg::size_cast<falg::float3>(yDir),
-        falg::size_cast<falg::float3>(xDir),
-        falg::size_cast<falg::float3>(zDir), 32, arrow_points,
-        _countof(arrow_points));
-
-    gizmo_renderable r;
-    r.mesh = geo;
-    r.color = falg::float4{1, 1, 1, 1};
-    for (auto &v : r.mesh.vertices) {
-      v.position = gizmoTransform.ApplyPosition(v.position);
-      v.normal = gizmoTransform.ApplyDirection(v.normal);
-    }
-    drawlist.push_back(r);
+    // rotate the local Y arrow to yDir
+    std::array<float, 16> basis{
+        xDir[0], xDir[1], xDir[2], 0, //
+        yDir[0], yDir[1], yDir[2], 0, //
+        zDir[0], zDir[1], zDir[2], 0, //
+        0,       0,       0,       1, //
+    };
+    falg::Transform arrowTransform{{0, 0, 0},
+                                   falg::RowMatrixToQuaternion(basis)};
+    impl->draw(gizmo, &componentArrow, arrowTransform * gizmoTransform, true);
   }
 }
 
-static void draw(std::vector<gizmo_renderable> &drawlist,
-                 const falg::Transform &gizmoTransform,
-                 const GizmoComponent *active) {
+static void draw(gizmo_system_impl *impl, const Gizmo &gizmo,
+                 const falg::Transform &gizmoTransform) {
   for (auto mesh : orientation_components) {
-    gizmo_renderable r{
-        mesh->mesh,
-        (mesh == active) ? mesh->base_color : mesh->highlight_color,
-    };
-    for (auto &v : r.mesh.vertices) {
-      v.position = gizmoTransform.ApplyPosition(v.position);
-      v.normal = gizmoTransform.ApplyDirection(v.normal);
-    }
-    drawlist.push_back(r);
+    impl->draw(gizmo, mesh, gizmoTransform, mesh == gizmo.active());
   }
 }
 
+void append_rotation_components(std::vector<const GizmoComponent *> &out) {
+  out.insert(out.end(), std::begin(orientation_components),
+             std::end(orientation_components));
+  out.push_back(&componentArrow);
+}
+
 namespace handle {
 
 bool rotation(const GizmoSystem &ctx, uint32_t id, bool is_local,
@@ -158,6 +189,9 @@ bool rotation(const GizmoSystem &ctx, uint32_t id, bool is_local,
               falg::float4 &r) {
   auto &impl = ctx.m_impl;
   auto [gizmo, created] = impl->get_or_create_gizmo(id);
+  if (!gizmo) {
+    return false;
+  }
 
   // assert(length2(t.orientation) > float(1e-6));
   auto worldRay = falg::Ray{impl->state.ray_origin, impl->state.ray_direction};
@@ -171,10 +205,24 @@ bool rotation(const GizmoSystem &ctx, uint32_t id, bool is_local,
     gizmoTransform.rotation = {0, 0, 0, 1};
   }
 
+  // outside the view the gizmo is neither picked nor drawn. a drag goes on
+  auto visible = impl->is_visible(rotation_sphere, gizmoTransform);
+
   // raycast
   {
-    auto localRay = worldRay.Transform(gizmoTransform.Inverse());
-    auto [mesh, best_t] = raycast(localRay);
+    // global gizmos take the path without rotation
+    auto localRay =
+        falg::DispatchTransform(gizmoTransform, [&](const auto &toWorld) {
+          return worldRay.Transform(toWorld.Inverse());
+        });
+    const GizmoComponent *mesh = nullptr;
+    float best_t = 0;
+    if (visible && impl->may_pick(*gizmo, orientation_components,
+                                  rotation_pick_sphere, gizmoTransform)) {
+      std::tie(mesh, best_t) =
+          raycast(localRay, impl->pick(gizmoTransform.translation));
+    }
+    gizmo->hover(mesh);
 
     // update
     if (impl->state.has_clicked) {
@@ -206,10 +254,12 @@ bool rotation(const GizmoSystem &ctx, uint32_t id, bool is_local,
   }
 
   // draw
-  if (!is_local && active) {
-    draw_global_active(impl->drawlist, gizmoTransform, active, gizmo->m_state);
-  } else {
-    draw(impl->drawlist, gizmoTransform, active);
+  if (visible) {
+    if (!is_local && active) {
+      draw_global_active(impl, *gizmo, gizmoTransform);
+    } else {
+      draw(impl, *gizmo, gizmoTransform);
+    }
   }
 
   return gizmo->isHoverOrActive();
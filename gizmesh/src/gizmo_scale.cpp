@@ -52,71 +52,104 @@ static bool dragger(const GizmoComponent &component, const falg::Ray &worldRay,
 static falg::float2 mace_points[] = {{0.25f, 0}, {0.25f, 0.05f}, {1, 0.05f},
                                      {1, 0.1f},  {1.25f, 0.1f},  {1.25f, 0}};
 
+// the shaft and the box of the head of mace_points
+static geometry_lines mace_lines(const falg::float3 &axis,
+                                 const falg::float3 &arm1,
+                                 const falg::float3 &arm2) {
+  geometry_lines lines;
+  lines.add_segment(axis * 0.25f, axis);
+  lines.add_box(axis, arm1, arm2, {1, -0.1f, -0.1f}, {1.25f, 0.1f, 0.1f});
+  return lines;
+}
+
+// the shaft, and a capsule around the cylinder of the head of mace_points
+static GizmoProxies mace_proxies(const falg::float3 &axis) {
+  GizmoProxies proxies;
+  proxies.capsules.push_back({axis * 0.25f, axis, 0.05f});
+  proxies.capsules.push_back({axis, axis * 1.25f, 0.1f});
+  return proxies;
+}
+
 static GizmoComponent xComponent{
-    geometry_mesh::make_lathed_geometry({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 16,
-                                        mace_points, _countof(mace_points)),
+    GizmoComponentId::ScaleX,
+    geometry_mesh::make_lathed_lods({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 16, 3,
+                                    mace_points, _countof(mace_points)),
+    mace_lines({1, 0, 0}, {0, 1, 0}, {0, 0, 1}),
+    mace_proxies({1, 0, 0}),
     {1, 0.5f, 0.5f, 1.f},
     {1, 0, 0, 1.f},
     {1, 0, 0}};
 static GizmoComponent yComponent{
-    geometry_mesh::make_lathed_geometry({0, 1, 0}, {0, 0, 1}, {1, 0, 0}, 16,
-                                        mace_points, _countof(mace_points)),
+    GizmoComponentId::ScaleY,
+    geometry_mesh::make_lathed_lods({0, 1, 0}, {0, 0, 1}, {1, 0, 0}, 16, 3,
+                                    mace_points, _countof(mace_points)),
+    mace_lines({0, 1, 0}, {0, 0, 1}, {1, 0, 0}),
+    mace_proxies({0, 1, 0}),
     {0.5f, 1, 0.5f, 1.f},
     {0, 1, 0, 1.f},
     {0, 1, 0}};
 static GizmoComponent zComponent{
-    geometry_mesh::make_lathed_geometry({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 16,
-                                        mace_points, _countof(mace_points)),
+    GizmoComponentId::ScaleZ,
+    geometry_mesh::make_lathed_lods({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 16, 3,
+                                    mace_points, _countof(mace_points)),
+    mace_lines({0, 0, 1}, {1, 0, 0}, {0, 1, 0}),
+    mace_proxies({0, 0, 1}),
     {0.5f, 0.5f, 1, 1.f},
     {0, 0, 1, 1.f},
     {0, 0, 1}};
 
 static const GizmoComponent *g_meshes[] = {&xComponent, &yComponent,
                                            &zComponent};
+static const falg::Sphere scale_sphere = bounding_sphere(g_meshes);
+static const falg::Sphere scale_pick_sphere =
+    bounding_sphere(g_meshes, &GizmoComponent::pick_sphere);
 
-static std::pair<const GizmoComponent *, float> raycast(const falg::Ray &ray) {
-  const GizmoComponent *updated_state = nullptr;
-  float best_t = std::numeric_limits<float>::infinity();
-  for (auto mesh : g_meshes) {
-    auto t = ray >> mesh->mesh;
-    if (t < best_t) {
-      updated_state = mesh;
-      best_t = t;
-    }
-  }
-  return std::make_pair(updated_state, best_t);
+static std::pair<const GizmoComponent *, float>
+raycast(const falg::Ray &ray, const GizmoPick &pick) {
+  return raycast_components(g_meshes, scale_pick_sphere, ray, pick);
 }
 
-static void draw(const falg::Transform &t,
-                 std::vector<gizmo_renderable> &drawlist,
-                 const GizmoComponent *activeMesh) {
+static void draw(const falg::Transform &t, gizmo_system_impl *impl,
+                 const Gizmo &gizmo) {
   for (auto mesh : g_meshes) {
-    gizmo_renderable r{
-        mesh->mesh,
-        (mesh == activeMesh) ? mesh->base_color : mesh->highlight_color,
-    };
-    for (auto &v : r.mesh.vertices) {
-      // transform local coordinates into worldspace
-      v.position = t.ApplyPosition(v.position);
-      v.normal = t.ApplyDirection(v.normal);
-    }
-    drawlist.push_back(r);
+    impl->draw(gizmo, mesh, t, mesh == gizmo.active());
   }
 }
 
+void append_scale_components(std::vector<const GizmoComponent *> &out) {
+  out.insert(out.end(), std::begin(g_meshes), std::end(g_meshes));
+}
+
 namespace handle {
 
 bool scale(const GizmoSystem &ctx, uint32_t id, bool is_uniform,
            const falg::float3 &t, const falg::float4 &r, falg::float3 &s) {
   auto &impl = ctx.m_impl;
   auto [gizmo, created] = impl->get_or_create_gizmo(id);
+  if (!gizmo) {
+    return false;
+  }
 
   auto worldRay = falg::Ray{impl->state.ray_origin, impl->state.ray_direction};
-  auto localRay = worldRay.Transform(falg::Transform{t, r}.Inverse());
+  auto localRay =
+      falg::DispatchTransform({t, r}, [&](const auto &toWorld) {
+        return worldRay.Transform(toWorld.Inverse());
+      });
 
-  if (impl->state.has_clicked) {
-    auto [updated_state, best_t] = raycast(localRay);
+  // outside the view the gizmo is neither picked nor drawn. a drag goes on
+  auto visible = impl->is_visible(scale_sphere, {t, r});
+  // registered every frame for GizmoSystem::set_arbitration
+  auto pickable =
+      visible && impl->may_pick(*gizmo, g_meshes, scale_pick_sphere, {t, r});
 
+  const GizmoComponent *updated_state = nullptr;
+  float best_t = 0;
+  if (pickable) {
+    std::tie(updated_state, best_t) = raycast(localRay, impl->pick(t));
+  }
+  gizmo->hover(updated_state);
+
+  if (impl->state.has_clicked) {
     if (updated_state) {
       auto localHit = localRay.SetT(best_t);
       auto offset = falg::Transform{t, r}.ApplyPosition(localHit) - t;
@@ -132,7 +165,9 @@ bool scale(const GizmoSystem &ctx, uint32_t id, bool is_uniform,
     }
   }
 
-  draw({t, r}, impl->drawlist, active);
+  if (visible) {
+    draw({t, r}, impl, *gizmo);
+  }
 
   return gizmo->isHoverOrActive();
 }
@@ -0,0 +1,186 @@
+#pragma once
+#include "gizmo.h"
+#include <array>
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace gizmesh {
+
+///
+/// id to Gizmo. open addressing with linear probing.
+///
+/// With a maxCount the slots and gizmos are allocated once in the
+/// constructor and the table refuses new ids when full. Without it, the table
+/// doubles when half full. Gizmos are allocated in chunks and never move, so
+/// Gizmo pointers are valid as long as the table.
+///
+class gizmo_table {
+  struct slot {
+    uint32_t id;
+    // nullptr for an unused slot
+    Gizmo *gizmo;
+  };
+  std::pmr::vector<slot> m_slots;
+  std::pmr::vector<Gizmo *> m_chunks;
+  uint32_t m_count = 0;
+  uint32_t m_maxCount = 0;
+
+  static const uint32_t chunk_size = 64;
+
+public:
+  gizmo_table(std::pmr::memory_resource *resource, uint32_t maxCount = 0)
+      : m_slots(resource), m_chunks(resource), m_maxCount(maxCount) {
+    uint32_t size = 16;
+    while (maxCount && size < maxCount * 2) {
+      size *= 2;
+    }
+    m_slots.resize(size);
+    if (maxCount) {
+      m_chunks.reserve((maxCount + chunk_size - 1) / chunk_size);
+      while (m_chunks.size() * chunk_size < maxCount) {
+        add_chunk();
+      }
+    }
+  }
+
+  ~gizmo_table() {
+    std::pmr::polymorphic_allocator<Gizmo> allocator(
+        m_chunks.get_allocator().resource());
+    for (auto chunk : m_chunks) {
+      allocator.deallocate(chunk, chunk_size);
+    }
+  }
+
+  gizmo_table(const gizmo_table &) = delete;
+  gizmo_table &operator=(const gizmo_table &) = delete;
+
+  uint32_t size() const { return m_count; }
+
+  Gizmo *find(uint32_t id) { return find_slot(id)->gizmo; }
+
+  // nullptr if the table is full
+  std::pair<Gizmo *, bool> get_or_create(uint32_t id) {
+    auto s = find_slot(id);
+    if (s->gizmo) {
+      return {s->gizmo, false};
+    }
+
+    if (m_maxCount) {
+      if (m_count >= m_maxCount) {
+        return {nullptr, false};
+      }
+    } else if ((m_count + 1) * 2 > m_slots.size()) {
+      rehash(static_cast<uint32_t>(m_slots.size() * 2));
+      s = find_slot(id);
+    }
+
+    if (m_count >= m_chunks.size() * chunk_size) {
+      add_chunk();
+    }
+    s->id = id;
+    s->gizmo = &m_chunks[m_count / chunk_size][m_count % chunk_size];
+    *s->gizmo = {};
+    s->gizmo->m_id = id;
+    ++m_count;
+    return {s->gizmo, true};
+  }
+
+private:
+  slot *find_slot(uint32_t id) {
+    // fibonacci hashing. size is power of 2
+    auto mask = static_cast<uint32_t>(m_slots.size() - 1);
+    auto i = (id * 2654435769u) & mask;
+    for (;; i = (i + 1) & mask) {
+      auto &s = m_slots[i];
+      if (!s.gizmo || s.id == id) {
+        return &s;
+      }
+    }
+  }
+
+  void rehash(uint32_t size) {
+    std::pmr::vector<slot> slots(size, m_slots.get_allocator());
+    std::swap(slots, m_slots);
+    for (auto &s : slots) {
+      if (s.gizmo) {
+        *find_slot(s.id) = s;
+      }
+    }
+  }
+
+  void add_chunk() {
+    std::pmr::polymorphic_allocator<Gizmo> allocator(
+        m_chunks.get_allocator().resource());
+    auto chunk = allocator.allocate(chunk_size);
+    for (uint32_t i = 0; i < chunk_size; ++i) {
+      new (chunk + i) Gizmo();
+    }
+    m_chunks.push_back(chunk);
+  }
+};
+
+///
+/// gizmo_table split by id for handles on several threads.
+///
+/// Unsharded, it is one gizmo_table without locking. Sharded, each shard has
+/// a lock that is held only for the lookup and maxCount is shared by all
+/// shards.
+///
+class gizmo_store {
+  struct shard {
+    std::mutex mutex;
+    std::optional<gizmo_table> table;
+  };
+  static const uint32_t shard_bits = 4;
+  std::array<shard, 1 << shard_bits> m_shards;
+  bool m_sharded = false;
+  uint32_t m_maxCount;
+  std::atomic<uint32_t> m_count{0};
+
+public:
+  gizmo_store(std::pmr::memory_resource *resource, uint32_t maxCount = 0)
+      : m_maxCount(maxCount) {
+    m_shards[0].table.emplace(resource, maxCount);
+  }
+
+  // drops all gizmos
+  void set_sharded(std::pmr::memory_resource *resource, bool sharded) {
+    m_sharded = sharded;
+    m_count = 0;
+    for (auto &s : m_shards) {
+      s.table.reset();
+      if (sharded) {
+        // a shard may hold any number of the gizmos
+        s.table.emplace(resource);
+      }
+    }
+    if (!sharded) {
+      m_shards[0].table.emplace(resource, m_maxCount);
+    }
+  }
+
+  // nullptr if maxCount is reached
+  std::pair<Gizmo *, bool> get_or_create(uint32_t id) {
+    if (!m_sharded) {
+      return m_shards[0].table->get_or_create(id);
+    }
+
+    // the high bits. gizmo_table probes with the low bits
+    auto &s = m_shards[(id * 2654435769u) >> (32 - shard_bits)];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (auto gizmo = s.table->find(id)) {
+      return {gizmo, false};
+    }
+    if (m_maxCount &&
+        m_count.fetch_add(1, std::memory_order_relaxed) >= m_maxCount) {
+      m_count.fetch_sub(1, std::memory_order_relaxed);
+      return {nullptr, false};
+    }
+    return s.table->get_or_create(id);
+  }
+};
+
+} // namespace gizmesh
@@ -45,45 +45,98 @@ static bool axisDragger(const GizmoComponent &component,
 static falg::float2 arrow_points[] = {
     {0.25f, 0}, {0.25f, 0.05f}, {1, 0.05f}, {1, 0.10f}, {1.2f, 0}};
 
+// the shaft and the outline of the head of arrow_points
+static geometry_lines arrow_lines(const falg::float3 &axis,
+                                  const falg::float3 &arm1,
+                                  const falg::float3 &arm2) {
+  geometry_lines lines;
+  lines.add_segment(axis * 0.25f, axis);
+  lines.add_cone(axis, axis * 1.2f, arm1 * 0.1f, arm2 * 0.1f, 8, 4);
+  return lines;
+}
+
+static geometry_lines box_lines(const falg::float3 &min,
+                                const falg::float3 &max) {
+  geometry_lines lines;
+  lines.add_box({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, min, max);
+  return lines;
+}
+
+// the shaft and the head of arrow_points
+static GizmoProxies arrow_proxies(const falg::float3 &axis) {
+  GizmoProxies proxies;
+  proxies.capsules.push_back({axis * 0.25f, axis, 0.05f});
+  proxies.cones.push_back({axis, axis * 1.2f, 0.1f});
+  return proxies;
+}
+
+static GizmoProxies box_proxies(const falg::float3 &min,
+                                const falg::float3 &max) {
+  GizmoProxies proxies;
+  proxies.boxes.push_back({min, max});
+  return proxies;
+}
+
 static GizmoComponent componentX{
-    geometry_mesh::make_lathed_geometry({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 16,
-                                        arrow_points, _countof(arrow_points)),
+    GizmoComponentId::TranslationX,
+    geometry_mesh::make_lathed_lods({1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 16, 3,
+                                    arrow_points, _countof(arrow_points)),
+    arrow_lines({1, 0, 0}, {0, 1, 0}, {0, 0, 1}),
+    arrow_proxies({1, 0, 0}),
     {1, 0.5f, 0.5f, 1.f},
     {1, 0, 0, 1.f},
     {1, 0, 0}};
 static GizmoComponent componentY{
-    geometry_mesh::make_lathed_geometry({0, 1, 0}, {0, 0, 1}, {1, 0, 0}, 16,
-                                        arrow_points, _countof(arrow_points)),
+    GizmoComponentId::TranslationY,
+    geometry_mesh::make_lathed_lods({0, 1, 0}, {0, 0, 1}, {1, 0, 0}, 16, 3,
+                                    arrow_points, _countof(arrow_points)),
+    arrow_lines({0, 1, 0}, {0, 0, 1}, {1, 0, 0}),
+    arrow_proxies({0, 1, 0}),
     {0.5f, 1, 0.5f, 1.f},
     {0, 1, 0, 1.f},
     {0, 1, 0}};
 static GizmoComponent componentZ{
-    geometry_mesh::make_lathed_geometry({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 16,
-                                        arrow_points, _countof(arrow_points)),
+    GizmoComponentId::TranslationZ,
+    geometry_mesh::make_lathed_lods({0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 16, 3,
+                                    arrow_points, _countof(arrow_points)),
+    arrow_lines({0, 0, 1}, {1, 0, 0}, {0, 1, 0}),
+    arrow_proxies({0, 0, 1}),
     {0.5f, 0.5f, 1, 1.f},
     {0, 0, 1, 1.f},
     {0, 0, 1}};
 static GizmoComponent componentXY{
+    GizmoComponentId::TranslationXY,
     geometry_mesh::make_box_geometry({0.25, 0.25, -0.01f},
                                      {0.75f, 0.75f, 0.01f}),
+    box_lines({0.25, 0.25, -0.01f}, {0.75f, 0.75f, 0.01f}),
+    box_proxies({0.25, 0.25, -0.01f}, {0.75f, 0.75f, 0.01f}),
     {1, 1, 0.5f, 0.5f},
     {1, 1, 0, 0.6f},
     {0, 0, 1}};
 static GizmoComponent componentYZ{
+    GizmoComponentId::TranslationYZ,
     geometry_mesh::make_box_geometry({-0.01f, 0.25, 0.25},
                                      {0.01f, 0.75f, 0.75f}),
+    box_lines({-0.01f, 0.25, 0.25}, {0.01f, 0.75f, 0.75f}),
+    box_proxies({-0.01f, 0.25, 0.25}, {0.01f, 0.75f, 0.75f}),
     {0.5f, 1, 1, 0.5f},
     {0, 1, 1, 0.6f},
     {1, 0, 0}};
 static GizmoComponent componentZX{
+    GizmoComponentId::TranslationZX,
     geometry_mesh::make_box_geometry({0.25, -0.01f, 0.25},
                                      {0.75f, 0.01f, 0.75f}),
+    box_lines({0.25, -0.01f, 0.25}, {0.75f, 0.01f, 0.75f}),
+    box_proxies({0.25, -0.01f, 0.25}, {0.75f, 0.01f, 0.75f}),
     {1, 0.5f, 1, 0.5f},
     {1, 0, 1, 0.6f},
     {0, 1, 0}};
 static GizmoComponent componentXYZ{
+    GizmoComponentId::TranslationXYZ,
     geometry_mesh::make_box_geometry({-0.05f, -0.05f, -0.05f},
                                      {0.05f, 0.05f, 0.05f}),
+    box_lines({-0.05f, -0.05f, -0.05f}, {0.05f, 0.05f, 0.05f}),
+    box_proxies({-0.05f, -0.05f, -0.05f}, {0.05f, 0.05f, 0.05f}),
     {0.9f, 0.9f, 0.9f, 0.25f},
     {1, 1, 1, 0.35f},
     {0, 0, 0}};
@@ -92,42 +145,38 @@ static const GizmoComponent *translation_components[] = {
     &componentX,  &componentY,  &componentZ,   &componentXY,
     &componentYZ, &componentZX, &componentXYZ,
 };
+static const falg::Sphere translation_sphere =
+    bounding_sphere(translation_components);
+static const falg::Sphere translation_pick_sphere =
+    bounding_sphere(translation_components, &GizmoComponent::pick_sphere);
 
-static std::pair<const GizmoComponent *, float> raycast(const falg::Ray &ray) {
-  const GizmoComponent *updated_state = nullptr;
-  float best_t = std::numeric_limits<float>::infinity();
-  for (auto c : translation_components) {
-    auto t = ray >> c->mesh;
-    if (t < best_t) {
-      updated_state = c;
-      best_t = t;
-    }
-  }
-  return std::make_pair(updated_state, best_t);
+static std::pair<const GizmoComponent *, float>
+raycast(const falg::Ray &ray, const GizmoPick &pick) {
+  return raycast_components(translation_components, translation_pick_sphere,
+                            ray, pick);
 }
 
 static void draw(Gizmo &gizmo, gizmo_system_impl *impl,
                  const falg::Transform &t) {
   for (auto c : translation_components) {
-    gizmo_renderable r{
-        c->mesh,
-        (c == gizmo.active()) ? c->base_color : c->highlight_color,
-    };
-    for (auto &v : r.mesh.vertices) {
-      v.position = t.ApplyPosition(
-          v.position); // transform local coordinates into worldspace
-      v.normal = t.ApplyDirection(v.normal);
-    }
-    impl->drawlist.push_back(r);
+    impl->draw(gizmo, c, t, c == gizmo.active());
   }
 }
 
+void append_translation_components(std::vector<const GizmoComponent *> &out) {
+  out.insert(out.end(), std::begin(translation_components),
+             std::end(translation_components));
+}
+
 namespace handle {
 bool translation(const GizmoSystem &ctx, uint32_t id, bool is_local,
                  const falg::Transform *parent, falg::float3 &t,
                  const falg::float4 &r) {
   auto &impl = ctx.m_impl;
   auto [gizmo, created] = impl->get_or_create_gizmo(id);
+  if (!gizmo) {
+    return false;
+  }
 
   // raycast
   auto worldRay = falg::Ray{impl->state.ray_origin, impl->state.ray_direction};
@@ -141,22 +190,35 @@ bool translation(const GizmoSystem &ctx, uint32_t id, bool is_local,
   if (!is_local) {
     gizmoTransform.rotation = {0, 0, 0, 1};
   }
-  auto localRay = worldRay.Transform(gizmoTransform.Inverse());
-  auto [mesh, best_t] = raycast(localRay);
-  gizmo->hover(mesh != nullptr);
+  // global gizmos take the path without rotation
+  auto localRay =
+      falg::DispatchTransform(gizmoTransform, [&](const auto &toWorld) {
+        return worldRay.Transform(toWorld.Inverse());
+      });
+  // outside the view the gizmo is neither picked nor drawn. a drag goes on
+  auto visible = impl->is_visible(translation_sphere, gizmoTransform);
+  const GizmoComponent *mesh = nullptr;
+  float best_t = 0;
+  if (visible && impl->may_pick(*gizmo, translation_components,
+                                translation_pick_sphere, gizmoTransform)) {
+    std::tie(mesh, best_t) =
+        raycast(localRay, impl->pick(gizmoTransform.translation));
+  }
+  gizmo->hover(mesh);
 
   // update
   if (impl->state.has_clicked) {
     if (mesh) {
+      falg::Affine toWorld(gizmoTransform);
       auto localHit = localRay.SetT(best_t);
       auto worldOffset =
-          gizmoTransform.ApplyPosition(localHit) - gizmoTransform.translation;
+          toWorld.ApplyPosition(localHit) - gizmoTransform.translation;
       falg::float3 axis;
       if (mesh == &componentXYZ) {
         axis = -falg::QuaternionZDir(impl->state.camera_rotation);
       } else {
         if (is_local) {
-          axis = gizmoTransform.ApplyDirection(mesh->axis);
+          axis = toWorld.ApplyDirection(mesh->axis);
         } else {
           axis = mesh->axis;
         }
@@ -188,7 +250,9 @@ bool translation(const GizmoSystem &ctx, uint32_t id, bool is_local,
   }
 
   // draw
-  draw(*gizmo, impl, gizmoTransform);
+  if (visible) {
+    draw(*gizmo, impl, gizmoTransform);
+  }
 
   return gizmo->isHoverOrActive();
 }
@@ -0,0 +1,557 @@
+#include "impl.h"
+#include <algorithm>
+#include <type_traits>
+
+namespace gizmesh {
+
+// the palette only grows, so indices in unchanged vertices stay valid
+static uint32_t palette_index(std::pmr::vector<falg::float4> &palette,
+                              const falg::float4 &color) {
+  for (size_t i = 0; i < palette.size(); ++i) {
+    if (palette[i] == color) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  if (palette.size() >= gizmo_output::max_palette) {
+    // should not happen with the built-in components
+    return static_cast<uint32_t>(palette.size() - 1);
+  }
+  palette.push_back(color);
+  return static_cast<uint32_t>(palette.size() - 1);
+}
+
+static GizmoSystem::Command make_command(const gizmo_renderable &r) {
+  auto aabb = r.component->bounds.Transform(r.transform);
+  GizmoSystem::Command command{};
+  command.gizmo = r.gizmo;
+  command.component = static_cast<uint32_t>(r.component->id);
+  command.lod = r.lod;
+  command.blend = r.translucent() ? GizmoSystem::Blend::Translucent
+                                  : GizmoSystem::Blend::Opaque;
+  command.flags = r.flags;
+  command.aabbMin = aabb.min;
+  command.aabbMax = aabb.max;
+  return command;
+}
+
+// merge with the last range if contiguous
+static void add_dirty(std::pmr::vector<GizmoSystem::Range> &ranges,
+                      size_t offset, size_t bytes) {
+  if (!ranges.empty()) {
+    auto &last = ranges.back();
+    if (last.offset + last.bytes == offset) {
+      last.bytes += static_cast<uint32_t>(bytes);
+      return;
+    }
+  }
+  ranges.push_back(
+      {static_cast<uint32_t>(offset), static_cast<uint32_t>(bytes)});
+}
+
+// T is falg::Affine or falg::Translation
+template <typename T>
+static void emit_vertices(const vertex_layout &layout, const T &m,
+                          const soa_float3 &positions,
+                          const soa_float3 &normals, const falg::float4 &color,
+                          const uint8_t *encodedColor, uint8_t *dst) {
+  auto colorSize = layout.stride - layout.colorOffset;
+
+  // transform local coordinates into worldspace, a block at a time
+  const size_t block = 64;
+  static_assert(block % soa_width == 0);
+  float position[3][block];
+  float normal[3][block];
+  for (size_t begin = 0; begin < positions.count; begin += block) {
+    auto count = std::min(block, positions.padded() - begin);
+    transform_positions(m, positions, begin, count, position[0], position[1],
+                        position[2]);
+    const float *n[] = {normal[0], normal[1], normal[2]};
+    if constexpr (std::is_same_v<T, falg::Translation>) {
+      // not rotated
+      n[0] = normals.x.data() + begin;
+      n[1] = normals.y.data() + begin;
+      n[2] = normals.z.data() + begin;
+    } else if (layout.has_normal()) {
+      transform_directions(m, normals, begin, count, normal[0], normal[1],
+                           normal[2]);
+    }
+
+    count = std::min(block, positions.count - begin);
+    if (layout.encode) {
+      layout.encode({{position[0], position[1], position[2]},
+                     {n[0], n[1], n[2]},
+                     color,
+                     static_cast<uint32_t>(count)},
+                    dst);
+      dst += count * layout.stride;
+      continue;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      encode_position(layout.format.position, dst + layout.positionOffset,
+                      {position[0][i], position[1][i], position[2][i]});
+      if (layout.normalOffset != ~0u) {
+        encode_normal(layout.format.normal, dst + layout.normalOffset,
+                      {n[0][i], n[1][i], n[2][i]});
+      }
+      memcpy(dst + layout.colorOffset, encodedColor, colorSize);
+      dst += layout.stride;
+    }
+  }
+}
+
+static void emit_vertices(const vertex_layout &layout,
+                          const gizmo_renderable &r, uint32_t paletteIndex,
+                          uint8_t *dst) {
+  uint8_t encodedColor[16] = {};
+  if (!layout.encode) {
+    encode_color(layout.format.color, encodedColor, r.color(), paletteIndex);
+  }
+  // global gizmos are not rotated, their vertices only move
+  falg::DispatchTransform(r.transform, [&](const auto &m) {
+    emit_vertices(layout, m, r.positions(), r.normals(), r.color(),
+                  encodedColor, dst);
+  });
+}
+
+static void emit_indices(const vertex_layout &layout,
+                         const std::vector<uint32_t> &indices, uint32_t offset,
+                         uint8_t *dst) {
+  if (layout.indexStride == 2) {
+    for (auto i : indices) {
+      auto index = static_cast<uint16_t>(offset + i);
+      memcpy(dst, &index, 2);
+      dst += 2;
+    }
+  } else {
+    for (auto i : indices) {
+      auto index = offset + i;
+      memcpy(dst, &index, 4);
+      dst += 4;
+    }
+  }
+}
+
+void gizmo_system_impl::merge_threads() {
+  size_t count = 0;
+  for (auto t : m_threads) {
+    count += t->frame->drawlist.size();
+  }
+  std::pmr::vector<draw_key> keys(&m_arena);
+  keys.reserve(count);
+  for (auto t : m_threads) {
+    auto &frame = *t->frame;
+    m_frame->overflow |= frame.overflow;
+    for (size_t i = 0; i < frame.drawlist.size(); ++i) {
+      auto &r = frame.drawlist[i];
+      keys.push_back({(uint64_t(r.gizmo) << 32) | i, &r});
+    }
+  }
+  std::sort(keys.begin(), keys.end(),
+            [](const draw_key &l, const draw_key &r) { return l.key < r.key; });
+
+  auto &drawlist = m_frame->drawlist;
+  drawlist.clear();
+  drawlist.reserve(keys.size());
+  for (auto &k : keys) {
+    drawlist.push_back(*k.renderable);
+  }
+}
+
+void gizmo_system_impl::arbitrate() {
+  std::pmr::vector<const gizmo_candidate *> candidates(&m_arena);
+  auto count = m_frame->candidates.size();
+  for (auto t : m_threads) {
+    count += t->frame->candidates.size();
+  }
+  candidates.reserve(count);
+  for (auto &c : m_frame->candidates) {
+    candidates.push_back(&c);
+  }
+  for (auto t : m_threads) {
+    for (auto &c : t->frame->candidates) {
+      candidates.push_back(&c);
+    }
+  }
+
+  std::pmr::vector<falg::AABB> bounds(&m_arena);
+  bounds.reserve(count);
+  for (auto c : candidates) {
+    auto sphere = grow_pick_sphere(c->sphere->Transform(c->transform), c->pick);
+    bounds.push_back(falg::AABB{sphere.center, sphere.center}.Grow(
+        sphere.radius));
+  }
+  m_broadphase.Build(bounds.data(), bounds.size());
+
+  falg::Ray ray{state.ray_origin, state.ray_direction};
+  const gizmo_candidate *nearest = nullptr;
+  m_broadphase.Traverse(ray, [&](uint32_t i, float tMax) {
+    auto c = candidates[i];
+    auto localRay =
+        falg::DispatchTransform(c->transform, [&](const auto &toWorld) {
+          return ray.Transform(toWorld.Inverse());
+        });
+    // the transform is rigid, t is the same on the world ray
+    auto t = raycast_components(*c, *c->sphere, localRay, c->pick).second;
+    if (t < tMax || (t == tMax && nearest && c->gizmo < nearest->gizmo)) {
+      nearest = c;
+    }
+    return t;
+  });
+  m_hot.reset();
+  if (nearest) {
+    m_hot = nearest->gizmo;
+  }
+}
+
+struct emit_context {
+  const vertex_layout *layout;
+  const emit_job *jobs;
+  gizmo_output *out;
+  // instead of out->vertices and out->indices
+  GizmoSystem::OutputStream *stream;
+};
+
+// components per job of the scheduler
+static const uint32_t emit_grain = 16;
+
+static void emit(void *p, uint32_t begin, uint32_t end) {
+  auto &context = *static_cast<emit_context *>(p);
+  auto &layout = *context.layout;
+  for (auto i = begin; i < end; ++i) {
+    auto &job = context.jobs[i];
+    auto &r = *job.renderable;
+    auto vertexOffset = job.baseVertex * layout.stride;
+    emit_vertices(layout, r, job.paletteIndex,
+                  context.stream
+                      ? context.stream->vertices(
+                            vertexOffset, r.vertex_count() * layout.stride)
+                      : context.out->vertices.data() + vertexOffset);
+    if (job.indices) {
+      auto indexOffset = job.firstIndex * layout.indexStride;
+      auto indexBytes =
+          static_cast<uint32_t>(r.indices().size()) * layout.indexStride;
+      emit_indices(layout, r.indices(), job.baseVertex,
+                   context.stream
+                       ? context.stream->indices(indexOffset, indexBytes)
+                       : context.out->indices.data() + indexOffset);
+    }
+  }
+}
+
+const gizmo_output &
+gizmo_system_impl::render(const GizmoSystem::VertexEncoder *encoder,
+                          GizmoSystem::OutputStream *stream) {
+  try {
+    return render_frame(encoder, stream);
+  } catch (const std::bad_alloc &) {
+    if (!m_arena.exhausted()) {
+      throw;
+    }
+    // a fixed arena ran out. the frame is dropped instead
+    auto &out = m_outputs[m_back];
+    out.clear();
+    out.dirtyVertices.clear();
+    out.dirtyIndices.clear();
+    out.dirtyInstances.clear();
+    out.overflow = m_frame->overflow | GizmoSystem::OverflowArena;
+    out.translucentFirstIndex = 0;
+    out.translucentIndexCount = 0;
+    out.streamed = false;
+    out.streamedVertexBytes = 0;
+    out.streamedIndexBytes = 0;
+    return out;
+  }
+}
+
+const gizmo_output &
+gizmo_system_impl::render_frame(const GizmoSystem::VertexEncoder *encoder,
+                                GizmoSystem::OutputStream *stream) {
+  if (m_concurrent) {
+    merge_threads();
+  }
+  if (m_arbitration) {
+    arbitrate();
+  }
+
+  auto &drawlist = m_frame->drawlist;
+  auto &out = m_outputs[m_back];
+  auto &drawn = out.drawn;
+  if (!out.consumed) {
+    // the consumer skipped this slot, its copy misses the last changes
+    out.clear();
+  }
+  if (out.primitive != m_primitive) {
+    // the indices are of the other primitive
+    out.clear();
+    out.primitive = m_primitive;
+  }
+  out.dirtyVertices.clear();
+  out.dirtyIndices.clear();
+  out.dirtyInstances.clear();
+  out.overflow = m_frame->overflow;
+  out.translucentFirstIndex = 0;
+  out.translucentIndexCount = 0;
+  out.streamed = false;
+
+  if (m_mode == GizmoSystem::OutputMode::Instanced) {
+    auto atlas = GizmoSystem::atlas();
+    out.instances.resize(drawlist.size());
+    out.commands.resize(drawlist.size());
+    for (size_t i = 0; i < drawlist.size(); ++i) {
+      auto &r = drawlist[i];
+      if (i < drawn.size() && drawn[i] == r) {
+        // same as the last frame
+        continue;
+      }
+
+      auto id = static_cast<size_t>(r.component->id);
+      auto &range = r.lines ? atlas.pLines[id]
+                            : atlas.pLods[id * atlas.lodCount + r.lod];
+      auto &command = out.commands[i];
+      command = make_command(r);
+      command.firstIndex = range.firstIndex;
+      command.indexCount = range.indexCount;
+      command.baseVertex = range.baseVertex;
+      command.vertexCount = range.vertexCount;
+      command.instance = static_cast<uint32_t>(i);
+
+      out.instances[i] = {
+          static_cast<uint32_t>(r.component->id),
+          r.flags,
+          r.transform.RowMatrix(),
+          r.color(),
+      };
+      add_dirty(out.dirtyInstances, i * sizeof(GizmoSystem::Instance),
+                sizeof(GizmoSystem::Instance));
+    }
+    drawn.assign(drawlist.begin(), drawlist.end());
+    return out;
+  }
+
+  auto layout = encoder ? vertex_layout(m_format, *encoder)
+                        : vertex_layout(m_format);
+  if (layout != out.layout || stream) {
+    // format or encoder changed. a stream is written whole
+    out.clear();
+    out.layout = layout;
+  }
+  size_t maxVertices = layout.max_vertices();
+  if (m_limits.maxVertices) {
+    maxVertices = std::min<size_t>(maxVertices, m_limits.maxVertices);
+  }
+  if (is_fixed() && !stream) {
+    // gizmo_output::reserve is sized for geometry_vertex
+    maxVertices = std::min<size_t>(
+        maxVertices,
+        m_limits.maxVertices * sizeof(geometry_vertex) / layout.stride);
+  }
+
+  // Combine all gizmo sub-meshes into one super-mesh.
+  // drop components that do not fit in the limits
+  size_t vertexCount = 0;
+  size_t indexCount = 0;
+  size_t opaqueIndexCount = 0;
+  auto fit = drawlist.begin();
+  for (auto &r : drawlist) {
+    auto vertices = r.vertex_count();
+    auto indices = r.indices().size();
+    if (vertexCount + vertices > maxVertices) {
+      out.overflow |= GizmoSystem::OverflowVertices;
+      continue;
+    }
+    if (m_limits.maxIndices && indexCount + indices > m_limits.maxIndices) {
+      out.overflow |= GizmoSystem::OverflowIndices;
+      continue;
+    }
+    vertexCount += vertices;
+    indexCount += indices;
+    if (!r.sorted()) {
+      opaqueIndexCount += indices;
+    }
+    *fit++ = r;
+  }
+  drawlist.erase(fit, drawlist.end());
+  if (stream) {
+    out.streamed = true;
+    out.streamedVertexBytes =
+        static_cast<uint32_t>(vertexCount * layout.stride);
+    out.streamedIndexBytes =
+        static_cast<uint32_t>(indexCount * layout.indexStride);
+    if (!stream->reserve(out.streamedVertexBytes, layout.stride,
+                         out.streamedIndexBytes, layout.indexStride)) {
+      out.overflow |=
+          GizmoSystem::OverflowVertices | GizmoSystem::OverflowIndices;
+      drawlist.clear();
+      out.streamedVertexBytes = 0;
+      out.streamedIndexBytes = 0;
+      indexCount = 0;
+      opaqueIndexCount = 0;
+    }
+  } else {
+    out.vertices.resize(vertexCount * layout.stride);
+    out.indices.resize(indexCount * layout.indexStride);
+  }
+  out.commands.resize(drawlist.size());
+  out.translucentFirstIndex = static_cast<uint32_t>(opaqueIndexCount);
+  out.translucentIndexCount =
+      static_cast<uint32_t>(indexCount - opaqueIndexCount);
+
+  // while the components match the last frame, the vertex and index ranges
+  // are the same. translucent components have no index range of their own,
+  // their triangles are sorted after the opaque ones. lines are not sorted
+  std::pmr::vector<emit_job> jobs(&m_arena);
+  jobs.reserve(drawlist.size());
+  std::pmr::vector<translucent_draw> translucent(&m_arena);
+  translucent.reserve(drawlist.size());
+  bool samePlace = true;
+  uint32_t offset = 0;
+  uint32_t firstIndex = 0;
+  for (size_t i = 0; i < drawlist.size(); ++i) {
+    auto &r = drawlist[i];
+    auto vertexCount = r.vertex_count();
+    auto indexCount =
+        r.sorted() ? 0 : static_cast<uint32_t>(r.indices().size());
+    samePlace = samePlace && i < drawn.size() &&
+                drawn[i].component == r.component && drawn[i].lod == r.lod &&
+                drawn[i].sorted() == r.sorted();
+    if (r.sorted()) {
+      translucent.push_back({&r, offset});
+    }
+
+    if (!samePlace || !(drawn[i] == r)) {
+      auto &command = out.commands[i];
+      command = make_command(r);
+      command.firstIndex = firstIndex;
+      command.indexCount = indexCount;
+      command.baseVertex = offset;
+      command.vertexCount = vertexCount;
+
+      auto paletteIndex =
+          layout.has_palette() ? palette_index(out.palette, r.color()) : 0;
+      jobs.push_back({&r, offset, firstIndex, paletteIndex,
+                      !samePlace && indexCount});
+      add_dirty(out.dirtyVertices, offset * layout.stride,
+                vertexCount * layout.stride);
+      if (!samePlace && indexCount) {
+        add_dirty(out.dirtyIndices, firstIndex * layout.indexStride,
+                  indexCount * layout.indexStride);
+      }
+    }
+
+    if (r.sorted()) {
+      // moves with the opaque index count, even when r is unchanged
+      out.commands[i].firstIndex = out.translucentFirstIndex;
+    }
+
+    offset += vertexCount;
+    firstIndex += indexCount;
+  }
+
+  // the jobs write disjoint ranges
+  emit_context context{&layout, jobs.data(), &out, stream};
+  static SerialJobScheduler s_serial;
+  auto scheduler = m_scheduler ? m_scheduler : &s_serial;
+  scheduler->parallel_for(&emit, &context, static_cast<uint32_t>(jobs.size()),
+                          emit_grain);
+  sort_translucent(layout, translucent, stream, out);
+  if (stream) {
+    // the next frame is written whole
+    drawn.clear();
+  } else {
+    drawn.assign(drawlist.begin(), drawlist.end());
+  }
+
+  return out;
+}
+
+// stable LSD radix sort of order by 16 bit keys, ascending.
+// scratch is as large as order
+static void radix_sort(const uint16_t *keys, uint32_t *order,
+                       uint32_t *scratch, size_t count) {
+  auto src = order;
+  auto dst = scratch;
+  for (int shift = 0; shift < 16; shift += 8) {
+    uint32_t offsets[257] = {};
+    for (size_t i = 0; i < count; ++i) {
+      ++offsets[((keys[src[i]] >> shift) & 0xff) + 1];
+    }
+    for (int b = 0; b < 256; ++b) {
+      offsets[b + 1] += offsets[b];
+    }
+    for (size_t i = 0; i < count; ++i) {
+      dst[offsets[(keys[src[i]] >> shift) & 0xff]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+  // an even number of passes ends in order
+}
+
+void gizmo_system_impl::sort_translucent(
+    const vertex_layout &layout,
+    const std::pmr::vector<translucent_draw> &draws,
+    GizmoSystem::OutputStream *stream, gizmo_output &out) {
+  size_t count = out.translucentIndexCount / 3;
+  if (count == 0) {
+    return;
+  }
+
+  // squared distance of each triangle centroid to the camera
+  std::pmr::vector<float> depth(count, &m_arena);
+  std::pmr::vector<uint32_t> triangles(count * 3, &m_arena);
+  const falg::float3 &eye = state.camera_position;
+  size_t t = 0;
+  for (auto &d : draws) {
+    auto &lod = d.renderable->geometry();
+    falg::DispatchTransform(d.renderable->transform, [&](const auto &m) {
+      for (size_t i = 0; i < lod.centroids.size(); ++i, ++t) {
+        auto v = m.ApplyPosition(lod.centroids[i]) - eye;
+        depth[t] = falg::Dot(v, v);
+        for (int k = 0; k < 3; ++k) {
+          triangles[t * 3 + k] = d.baseVertex + lod.mesh.triangles[i * 3 + k];
+        }
+      }
+    });
+  }
+
+  // quantized, the farthest first
+  auto [nearest, farthest] = std::minmax_element(depth.begin(), depth.end());
+  auto range = *farthest - *nearest;
+  auto scale = range > 0 ? 65535 / range : 0;
+  std::pmr::vector<uint16_t> keys(count, &m_arena);
+  std::pmr::vector<uint32_t> order(count, &m_arena);
+  std::pmr::vector<uint32_t> scratch(count, &m_arena);
+  for (size_t i = 0; i < count; ++i) {
+    keys[i] = static_cast<uint16_t>((*farthest - depth[i]) * scale);
+    order[i] = static_cast<uint32_t>(i);
+  }
+  radix_sort(keys.data(), order.data(), scratch.data(), count);
+
+  // only a changed order is uploaded
+  auto bytes = count * 3 * layout.indexStride;
+  std::pmr::vector<uint8_t> sorted(bytes, &m_arena);
+  auto dst = sorted.data();
+  for (auto i : order) {
+    for (int k = 0; k < 3; ++k) {
+      auto index = triangles[i * 3 + k];
+      if (layout.indexStride == 2) {
+        auto index16 = static_cast<uint16_t>(index);
+        memcpy(dst, &index16, 2);
+      } else {
+        memcpy(dst, &index, 4);
+      }
+      dst += layout.indexStride;
+    }
+  }
+  auto offset = out.translucentFirstIndex * layout.indexStride;
+  if (stream) {
+    memcpy(stream->indices(static_cast<uint32_t>(offset),
+                           static_cast<uint32_t>(bytes)),
+           sorted.data(), bytes);
+    add_dirty(out.dirtyIndices, offset, bytes);
+  } else if (memcmp(out.indices.data() + offset, sorted.data(), bytes) != 0) {
+    memcpy(out.indices.data() + offset, sorted.data(), bytes);
+    add_dirty(out.dirtyIndices, offset, bytes);
+  }
+}
+
+} // namespace gizmesh
@@ -1,8 +1,15 @@
 #pragma once
+#include "frame_arena.h"
 #include "gizmo.h"
+#include "gizmo_table.h"
+#include "vertex_format.h"
+#include <atomic>
 #include <falg.h>
 #include <memory>
-#include <unordered_map>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <tuple>
 
 
 namespace gizmesh {
@@ -24,31 +31,343 @@ struct GizmoFrameState {
   // State to describe if the user has released the left mouse button during the
   // last frame
   bool has_released{false};
+
+  // GizmoSystem::View. pixels of a unit at distance 1, 0 without a view
+  float lod_scale{0};
+  // GizmoSystem::View::viewProjection. contains everything without a view
+  falg::Frustum frustum{};
 };
 
+// A component to draw. geometry is emitted in gizmo_system_impl::render()
 struct gizmo_renderable {
-  geometry_mesh mesh;
-  falg::float4 color;
+  uint32_t gizmo;
+  const GizmoComponent *component;
+  // GizmoComponent::lods
+  uint32_t lod;
+  falg::Transform transform;
+  // GizmoSystem::InstanceFlags
+  uint32_t flags;
+  // GizmoSystem::Primitive::Lines. the outline, lod is 0
+  bool lines;
+
+  const GizmoLod &geometry() const { return component->lods[lod]; }
+  const soa_float3 &positions() const {
+    return lines ? component->outline.positions : geometry().positions;
+  }
+  const soa_float3 &normals() const {
+    return lines ? component->outline.normals : geometry().normals;
+  }
+  // a triangle list, or a line list
+  const std::vector<uint32_t> &indices() const {
+    return lines ? component->outline.geometry.lines
+                 : geometry().mesh.triangles;
+  }
+  uint32_t vertex_count() const {
+    return static_cast<uint32_t>(positions().count);
+  }
+  bool active() const { return flags & GizmoSystem::InstanceActive; }
+  const falg::float4 &color() const {
+    return active() ? component->base_color : component->highlight_color;
+  }
+  // GizmoSystem::Blend::Translucent
+  bool translucent() const { return color()[3] < 1.0f; }
+  // the triangles of a translucent component are depth sorted, lines are not
+  bool sorted() const { return !lines && translucent(); }
+
+  bool operator==(const gizmo_renderable &rhs) const {
+    return gizmo == rhs.gizmo && component == rhs.component &&
+           lod == rhs.lod && transform.translation == rhs.transform.translation &&
+           transform.rotation == rhs.transform.rotation && flags == rhs.flags &&
+           lines == rhs.lines;
+  }
+};
+
+// A visible gizmo for the broadphase of GizmoSystem::set_arbitration.
+// the narrow phase is raycast_components of its components
+struct gizmo_candidate {
+  uint32_t gizmo;
+  const GizmoComponent *const *first;
+  const GizmoComponent *const *last;
+  // bounding_sphere of pick_sphere
+  const falg::Sphere *sphere;
+  falg::Transform transform;
+  GizmoPick pick;
+
+  const GizmoComponent *const *begin() const { return first; }
+  const GizmoComponent *const *end() const { return last; }
+};
+
+// built-in components of each gizmo.
+// defined in gizmo_translation.cpp, gizmo_rotation.cpp and gizmo_scale.cpp
+void append_translation_components(std::vector<const GizmoComponent *> &out);
+void append_rotation_components(std::vector<const GizmoComponent *> &out);
+void append_scale_components(std::vector<const GizmoComponent *> &out);
+
+// a changed component, written by a job of gizmo_system_impl::render()
+struct emit_job {
+  const gizmo_renderable *renderable;
+  uint32_t baseVertex;
+  uint32_t firstIndex;
+  uint32_t paletteIndex;
+  // moved, the indices are written too
+  bool indices;
+};
+
+// a translucent component. its triangles are sorted by
+// gizmo_system_impl::sort_translucent()
+struct translucent_draw {
+  const gizmo_renderable *renderable;
+  uint32_t baseVertex;
+};
+
+// scratch of gizmo_system_impl::sort_translucent() per triangle: depth, key,
+// 3 indices, two orders and the encoded indices
+const size_t sort_bytes_per_triangle =
+    sizeof(float) + sizeof(uint16_t) + 5 * sizeof(uint32_t) +
+    3 * sizeof(uint32_t);
+
+// orders the drawlists of concurrent threads.
+// gizmo id in the high bits, order in the thread in the low bits.
+// a gizmo is drawn by one thread, so the keys are unique
+struct draw_key {
+  uint64_t key;
+  const gizmo_renderable *renderable;
+};
+
+// Everything built in a frame. Allocated from the frame_arena
+struct gizmo_frame {
+  std::pmr::vector<gizmo_renderable> drawlist;
+  // GizmoSystem::set_arbitration
+  std::pmr::vector<gizmo_candidate> candidates;
+  // GizmoSystem::OverflowFlags
+  uint32_t overflow = 0;
+
+  gizmo_frame(std::pmr::memory_resource *resource)
+      : drawlist(resource), candidates(resource) {}
+
+  // arena block that holds a frame and the scratch of render() at the limits
+  static size_t arena_size(const GizmoSystem::Limits &limits) {
+    auto frame = limits.maxDraws * sizeof(gizmo_renderable) +
+                 limits.maxGizmos * sizeof(gizmo_candidate) + 256;
+    if (limits.maxScratchBytes) {
+      return frame + limits.maxScratchBytes;
+    }
+    return frame +
+           limits.maxDraws *
+               (sizeof(emit_job) + sizeof(draw_key) + sizeof(translucent_draw)) +
+           limits.maxGizmos *
+               (sizeof(const gizmo_candidate *) + sizeof(falg::AABB)) +
+           limits.maxIndices / 3 * sort_bytes_per_triangle + 256;
+  }
+
+  void reserve(const GizmoSystem::Limits &limits) {
+    drawlist.reserve(limits.maxDraws);
+    candidates.reserve(limits.maxGizmos);
+  }
+};
+
+// The buffers end() returns. They are kept across frames and only the
+// components that changed since this output was last rendered are emitted
+// again. Everything a Buffer points to lives here, so a published output
+// stays valid while the next frame is built.
+// Allocated from the long-lived resource
+struct gizmo_output {
+  // GizmoSystem::Buffer::slot
+  uint32_t slot = 0;
+  // the consumer has uploaded the contents. see gizmo_system_impl::release
+  bool consumed = true;
+  // encoded in vertex_layout
+  vertex_layout layout;
+  // indices is a line list for GizmoSystem::Primitive::Lines
+  GizmoSystem::Primitive primitive = GizmoSystem::Primitive::Triangles;
+  // what the buffers hold
+  std::pmr::vector<gizmo_renderable> drawn;
+  std::pmr::vector<uint8_t> vertices;
+  std::pmr::vector<uint8_t> indices;
+  std::pmr::vector<falg::float4> palette;
+  std::pmr::vector<GizmoSystem::Instance> instances;
+  std::pmr::vector<GizmoSystem::Command> commands;
+  // changed by the last render()
+  std::pmr::vector<GizmoSystem::Range> dirtyVertices;
+  std::pmr::vector<GizmoSystem::Range> dirtyIndices;
+  std::pmr::vector<GizmoSystem::Range> dirtyInstances;
+  // GizmoSystem::OverflowFlags of the last render()
+  uint32_t overflow = 0;
+  // GizmoSystem::Buffer::translucentFirstIndex
+  uint32_t translucentFirstIndex = 0;
+  uint32_t translucentIndexCount = 0;
+  // the last render() wrote to a GizmoSystem::OutputStream. vertices and
+  // indices are empty
+  bool streamed = false;
+  uint32_t streamedVertexBytes = 0;
+  uint32_t streamedIndexBytes = 0;
+
+  static const size_t max_palette = 256;
+
+  gizmo_output(std::pmr::memory_resource *resource)
+      : drawn(resource), vertices(resource), indices(resource),
+        palette(resource), instances(resource), commands(resource),
+        dirtyVertices(resource), dirtyIndices(resource),
+        dirtyInstances(resource) {}
+
+  void reserve(const GizmoSystem::Limits &limits) {
+    drawn.reserve(limits.maxDraws);
+    vertices.reserve(limits.maxVertices * sizeof(geometry_vertex));
+    indices.reserve(limits.maxIndices * sizeof(uint32_t));
+    palette.reserve(max_palette);
+    instances.reserve(limits.maxDraws);
+    commands.reserve(limits.maxDraws);
+    dirtyVertices.reserve(limits.maxDraws);
+    dirtyIndices.reserve(limits.maxDraws);
+    dirtyInstances.reserve(limits.maxDraws);
+  }
+
+  // everything is emitted again
+  void clear() {
+    drawn.clear();
+    vertices.clear();
+    indices.clear();
+    palette.clear();
+    instances.clear();
+    commands.clear();
+  }
+};
+
+// The frame of one thread that calls handles concurrently.
+// Merged into the main gizmo_frame by render()
+struct thread_frame {
+  std::thread::id thread;
+  frame_arena arena;
+  std::optional<gizmo_frame> frame;
+
+  thread_frame(std::thread::id thread, std::pmr::memory_resource *resource)
+      : thread(thread), arena(resource) {
+    frame.emplace(&arena);
+  }
+
+  void reset() {
+    frame.reset();
+    arena.reset();
+    frame.emplace(&arena);
+  }
 };
 
 struct gizmo_system_impl {
 private:
-  gizmesh::geometry_mesh m_r{};
-  std::unordered_map<uint32_t, std::unique_ptr<Gizmo>> m_gizmos;
+  // long-lived state
+  std::pmr::memory_resource *m_resource;
+  GizmoSystem::Limits m_limits;
+  gizmo_store m_gizmos;
+  GizmoSystem::OutputMode m_mode;
+  GizmoSystem::Format m_format;
+  GizmoSystem::Primitive m_primitive = GizmoSystem::Primitive::Triangles;
+  GizmoSystem::Picking m_picking = GizmoSystem::Picking::Proxies;
+  float m_pick_tolerance = 2;
+  // GizmoSystem::set_arbitration. the gizmo that picks in this frame, found
+  // by arbitrate() over the candidates of the last one
+  bool m_arbitration = false;
+  std::optional<uint32_t> m_hot;
+  falg::Bvh m_broadphase;
+  // nullptr runs on the calling thread
+  JobScheduler *m_scheduler = nullptr;
+
+  // [0] unless triple buffered. m_back is built by render(), m_ready holds the
+  // last published slot and m_front is read by the consumer thread.
+  // Ownership moves only by exchanging m_ready, so neither side waits.
+  std::array<gizmo_output, 3> m_outputs;
+  bool m_tripleBuffered = false;
+  uint32_t m_back = 0;
+  std::atomic<uint32_t> m_ready{1};
+  uint32_t m_front = 2;
+  static const uint32_t slot_mask = 3;
+  // m_ready was published and not acquired yet
+  static const uint32_t fresh_bit = 4;
+
+  // transient state. m_frame is rebuilt after m_arena.reset()
+  frame_arena m_arena;
+  std::optional<gizmo_frame> m_frame;
+
+  // GizmoSystem::set_concurrent. handles draw into the thread_frame of the
+  // calling thread, found by thread id once per thread and cached by m_serial
+  bool m_concurrent = false;
+  uint64_t m_serial;
+  std::mutex m_threadsMutex;
+  std::pmr::vector<thread_frame *> m_threads;
+  std::atomic<uint32_t> m_drawCount{0};
+  inline static std::atomic<uint64_t> s_serial{0};
 
 public:
-  std::vector<gizmo_renderable> drawlist;
+  gizmo_system_impl(GizmoSystem::OutputMode mode,
+                    std::pmr::memory_resource *resource,
+                    const GizmoSystem::Limits &limits = {})
+      : m_resource(resource), m_limits(limits),
+        m_gizmos(resource, limits.maxGizmos), m_mode(mode),
+        m_outputs{{{resource}, {resource}, {resource}}},
+        m_arena(resource, is_fixed() ? gizmo_frame::arena_size(limits) : 4096,
+                is_fixed()),
+        m_serial(++s_serial), m_threads(resource) {
+    for (uint32_t i = 0; i < m_outputs.size(); ++i) {
+      m_outputs[i].slot = i;
+    }
+    if (is_fixed()) {
+      m_outputs[0].reserve(limits);
+      m_broadphase.Reserve(limits.maxGizmos);
+    }
+    new_frame();
+  }
+
+  ~gizmo_system_impl() { clear_threads(); }
+
+  gizmo_system_impl(const gizmo_system_impl &) = delete;
+  gizmo_system_impl &operator=(const gizmo_system_impl &) = delete;
+
+  // all limits are set. no allocation after the constructor
+  bool is_fixed() const {
+    return m_limits.maxGizmos && m_limits.maxDraws && m_limits.maxVertices &&
+           m_limits.maxIndices;
+  }
+
+  void set_format(const GizmoSystem::Format &format) { m_format = format; }
+
+  void set_primitive(GizmoSystem::Primitive primitive) {
+    m_primitive = primitive;
+  }
+  bool is_lines() const { return m_primitive == GizmoSystem::Primitive::Lines; }
 
+  void set_picking(GizmoSystem::Picking picking, float tolerancePixels) {
+    m_picking = picking;
+    m_pick_tolerance = tolerancePixels;
+  }
+
+  void set_arbitration(bool enable) {
+    m_arbitration = enable;
+    m_hot.reset();
+  }
+
+  void set_scheduler(JobScheduler *scheduler) { m_scheduler = scheduler; }
+
+  void set_triple_buffered(bool enable) {
+    m_tripleBuffered = enable;
+    if (enable && is_fixed()) {
+      m_outputs[1].reserve(m_limits);
+      m_outputs[2].reserve(m_limits);
+    }
+  }
+
+  // drops all gizmos
+  void set_concurrent(bool enable) {
+    m_concurrent = enable;
+    m_gizmos.set_sharded(m_resource, enable);
+    clear_threads();
+  }
+
+  // nullptr if GizmoSystem::Limits::maxGizmos is reached
   std::pair<Gizmo *, bool> get_or_create_gizmo(uint32_t id) {
-    auto found = m_gizmos.find(id);
-    bool created = false;
-    if (found == m_gizmos.end()) {
-      // not found
-      found =
-          m_gizmos.insert(std::make_pair(id, std::make_unique<Gizmo>())).first;
-      created = true;
+    auto found = m_gizmos.get_or_create(id);
+    if (!found.first) {
+      current_frame().overflow |= GizmoSystem::OverflowGizmos;
     }
-    return std::make_pair(found->second.get(), created);
+    return found;
   }
 
   GizmoFrameState state;
@@ -60,28 +379,193 @@ public:
     this->state.has_clicked = !lastButton && state.button;
     this->state.has_released = lastButton && !state.button;
 
-    drawlist.clear();
-    m_r.clear();
-  }
-
-  const geometry_mesh &render() {
-    // Combine all gizmo sub-meshes into one super-mesh
-    for (auto &m : drawlist) {
-      uint32_t offset = (uint32_t)m_r.vertices.size();
-      auto it = m_r.vertices.insert(m_r.vertices.end(), m.mesh.vertices.begin(),
-                                    m.mesh.vertices.end());
-      for (auto tri = m.mesh.triangles.begin(); tri != m.mesh.triangles.end();
-           tri += 3) {
-        m_r.triangles.push_back(offset + tri[0]);
-        m_r.triangles.push_back(offset + tri[1]);
-        m_r.triangles.push_back(offset + tri[2]);
+    new_frame();
+  }
+
+  // Output a component placed by transform.
+  // active component is drawn with base_color, others with highlight_color.
+  void draw(const Gizmo &gizmo, const GizmoComponent *component,
+            const falg::Transform &transform, bool active) {
+    if (!is_visible(component->sphere, transform)) {
+      return;
+    }
+    auto &frame = current_frame();
+    auto &drawlist = frame.drawlist;
+    if (m_limits.maxDraws &&
+        (m_concurrent ? m_drawCount.fetch_add(1, std::memory_order_relaxed)
+                      : drawlist.size()) >= m_limits.maxDraws) {
+      frame.overflow |= GizmoSystem::OverflowDraws;
+      return;
+    }
+    uint32_t flags = 0;
+    if (active) {
+      flags |= GizmoSystem::InstanceActive;
+    }
+    if (component == gizmo.hovered()) {
+      flags |= GizmoSystem::InstanceHover;
+    }
+    uint32_t lod = 0;
+    if (!is_lines()) {
+      lod = component->select_lod(pixels_per_unit(transform.translation),
+                                  GizmoComponent::draw_tolerance);
+    }
+    drawlist.push_back(
+        {gizmo.m_id, component, lod, transform, flags, is_lines()});
+  }
+
+  // local bounds of a gizmo or a component placed by transform are in the view
+  bool is_visible(const falg::Sphere &sphere,
+                  const falg::Transform &transform) const {
+    return state.frustum.Intersects(sphere.Transform(transform));
+  }
+
+  // pixels covered by a unit of a gizmo at position. infinite without a
+  // GizmoSystem::View, which selects the finest level of detail
+  float pixels_per_unit(const falg::float3 &position) const {
+    auto distance = falg::Length(position - state.camera_position);
+    if (state.lod_scale <= 0 || distance <= 0) {
+      return std::numeric_limits<float>::infinity();
+    }
+    return state.lod_scale / distance;
+  }
+
+  // GizmoComponent::raycast of a gizmo at position
+  GizmoPick pick(const falg::float3 &position) const {
+    return {pixels_per_unit(position), is_lines(),
+            m_picking == GizmoSystem::Picking::Proxies, m_pick_tolerance};
+  }
+
+  // a visible gizmo may pick its components in this frame. with
+  // GizmoSystem::set_arbitration it is registered for the broadphase of
+  // render() and picks only if it won the last frame. sphere is the
+  // bounding_sphere of pick_sphere
+  template <size_t N>
+  bool may_pick(const Gizmo &gizmo,
+                const GizmoComponent *const (&components)[N],
+                const falg::Sphere &sphere, const falg::Transform &transform) {
+    if (!m_arbitration) {
+      return true;
+    }
+    auto &candidates = current_frame().candidates;
+    if (!m_limits.maxGizmos || candidates.size() < m_limits.maxGizmos) {
+      candidates.push_back({gizmo.m_id, components, components + N, &sphere,
+                            transform, pick(transform.translation)});
+    }
+    return m_hot == gizmo.m_id;
+  }
+
+  // emit the drawlist in the output mode and format, or by encoder. to stream
+  // instead of the gizmo_output buffers. a frame that runs out of a fixed
+  // m_arena is dropped with GizmoSystem::OverflowArena
+  const gizmo_output &render(const GizmoSystem::VertexEncoder *encoder,
+                             GizmoSystem::OutputStream *stream);
+
+  // hand the rendered output to the consumer and take another slot to build
+  // the next frame. a published output that is never acquired is replaced
+  void publish() {
+    if (!m_tripleBuffered) {
+      return;
+    }
+    m_outputs[m_back].consumed = false;
+    auto ready =
+        m_ready.exchange(m_back | fresh_bit, std::memory_order_acq_rel);
+    m_back = ready & slot_mask;
+  }
+
+  // consumer thread. the last published output, nullptr if there is none
+  // since the previous acquire()
+  const gizmo_output *acquire() {
+    if (!m_tripleBuffered ||
+        !(m_ready.load(std::memory_order_relaxed) & fresh_bit)) {
+      return nullptr;
+    }
+    // only the producer sets fresh_bit, so it is still set at this exchange
+    auto ready = m_ready.exchange(m_front, std::memory_order_acq_rel);
+    m_front = ready & slot_mask;
+    return &m_outputs[m_front];
+  }
+
+  // consumer thread. the acquired output is uploaded, so the next render()
+  // into its slot may write only the changes. otherwise it is written whole
+  void release() { m_outputs[m_front].consumed = true; }
+
+private:
+  const gizmo_output &render_frame(const GizmoSystem::VertexEncoder *encoder,
+                                   GizmoSystem::OutputStream *stream);
+
+  gizmo_frame &current_frame() {
+    if (!m_concurrent) {
+      return *m_frame;
+    }
+
+    struct cache {
+      uint64_t serial;
+      thread_frame *frame;
+    };
+    static thread_local cache t_cache{};
+    if (t_cache.serial != m_serial) {
+      t_cache = {m_serial, find_thread(std::this_thread::get_id())};
+    }
+    return *t_cache.frame->frame;
+  }
+
+  thread_frame *find_thread(std::thread::id thread) {
+    std::lock_guard<std::mutex> lock(m_threadsMutex);
+    for (auto t : m_threads) {
+      if (t->thread == thread) {
+        return t;
       }
-      for (; it != m_r.vertices.end(); ++it)
-        it->color =
-            m.color; // Take the color and shove it into a per-vertex attribute
     }
+    std::pmr::polymorphic_allocator<thread_frame> allocator(m_resource);
+    auto t = allocator.allocate(1);
+    allocator.construct(t, thread, m_resource);
+    m_threads.push_back(t);
+    return t;
+  }
 
-    return m_r;
+  void clear_threads() {
+    std::pmr::polymorphic_allocator<thread_frame> allocator(m_resource);
+    for (auto t : m_threads) {
+      t->~thread_frame();
+      allocator.deallocate(t, 1);
+    }
+    m_threads.clear();
+    // cached thread_frames are stale
+    m_serial = ++s_serial;
+  }
+
+  // the thread drawlists ordered by gizmo id, so the output does not depend
+  // on which thread ran a handle
+  void merge_threads();
+
+  // the nearest hit of the ray over the candidates of all threads. a BVH of
+  // their world bounds is traversed front to back, so only the candidates
+  // that may be nearer than the best hit so far run the narrow phase. ties go
+  // to the lower gizmo id
+  void arbitrate();
+
+  // indices of the translucent triangles back to front from the camera,
+  // written to out.indices, or stream, from out.translucentFirstIndex
+  void sort_translucent(const vertex_layout &layout,
+                        const std::pmr::vector<translucent_draw> &draws,
+                        GizmoSystem::OutputStream *stream, gizmo_output &out);
+
+  // drop last frame and reuse its memory
+  void new_frame() {
+    auto drawCount = m_frame ? m_frame->drawlist.size() : 0;
+    m_frame.reset();
+    m_arena.reset();
+    m_frame.emplace(&m_arena);
+    if (is_fixed()) {
+      // the only allocations of a frame. never grows after this
+      m_frame->reserve(m_limits);
+    } else {
+      m_frame->drawlist.reserve(drawCount);
+    }
+    for (auto t : m_threads) {
+      t->reset();
+    }
+    m_drawCount = 0;
   }
 };
 
@@ -0,0 +1,221 @@
+#include "gizmesh.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gizmesh {
+
+void JobScheduler::parallel_for(JobFunction function, void *context,
+                                uint32_t count, uint32_t grain) {
+  if (grain == 0) {
+    grain = 1;
+  }
+  for (uint32_t begin = 0; begin < count;) {
+    auto end = count - begin > grain ? begin + grain : count;
+    submit(function, context, begin, end);
+    begin = end;
+  }
+  wait();
+}
+
+void SerialJobScheduler::submit(JobFunction function, void *context,
+                                uint32_t begin, uint32_t end) {
+  function(context, begin, end);
+}
+
+void SerialJobScheduler::parallel_for(JobFunction function, void *context,
+                                      uint32_t count, uint32_t) {
+  if (count) {
+    function(context, 0, count);
+  }
+}
+
+struct job {
+  JobScheduler::JobFunction function;
+  void *context;
+  uint32_t begin;
+  uint32_t end;
+};
+
+// a fixed ring of jobs, so a submit does not allocate
+struct job_queue {
+  static const uint32_t capacity = 256;
+
+  std::mutex mutex;
+  job jobs[capacity];
+  uint32_t first = 0;
+  uint32_t count = 0;
+
+  bool push_back(const job &j) {
+    if (count == capacity) {
+      return false;
+    }
+    jobs[(first + count++) % capacity] = j;
+    return true;
+  }
+
+  job pop_back() { return jobs[(first + --count) % capacity]; }
+
+  job pop_front() {
+    auto j = jobs[first];
+    first = (first + 1) % capacity;
+    --count;
+    return j;
+  }
+};
+
+struct job_pool_impl {
+  std::vector<std::thread> threads;
+  // one per worker. other threads submit round robin
+  std::unique_ptr<job_queue[]> queues;
+  uint32_t queueCount;
+  std::atomic<uint32_t> next{0};
+  // in the queues
+  std::atomic<uint32_t> queued{0};
+  // submitted and not finished
+  std::atomic<uint32_t> pending{0};
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  bool quit = false;
+
+  // the worker index on a worker thread of this pool
+  static thread_local const job_pool_impl *t_pool;
+  static thread_local uint32_t t_index;
+
+  job_pool_impl(uint32_t threadCount)
+      : queues(new job_queue[threadCount ? threadCount : 1]),
+        queueCount(threadCount ? threadCount : 1) {
+    for (uint32_t i = 0; i < threadCount; ++i) {
+      threads.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~job_pool_impl() {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      quit = true;
+    }
+    wake.notify_all();
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  void submit(const job &j) {
+    auto index = t_pool == this
+                     ? t_index
+                     : next.fetch_add(1, std::memory_order_relaxed) %
+                           queueCount;
+    bool pushed;
+    {
+      auto &q = queues[index];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      pushed = q.push_back(j);
+      if (pushed) {
+        pending.fetch_add(1);
+        queued.fetch_add(1);
+      }
+    }
+    if (!pushed) {
+      // the queue is full
+      j.function(j.context, j.begin, j.end);
+      return;
+    }
+    {
+      // a worker between its check and its wait sees queued
+      std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+  }
+
+  // the newest job of queue index, else the oldest of another queue
+  bool try_run(uint32_t index) {
+    job j;
+    if (!pop(index, &j)) {
+      return false;
+    }
+    j.function(j.context, j.begin, j.end);
+    pending.fetch_sub(1);
+    return true;
+  }
+
+  bool pop(uint32_t index, job *j) {
+    if (queued.load() == 0) {
+      return false;
+    }
+    {
+      auto &q = queues[index];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.count) {
+        *j = q.pop_back();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    for (uint32_t i = 1; i < queueCount; ++i) {
+      auto &q = queues[(index + i) % queueCount];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.count) {
+        *j = q.pop_front();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void wait() {
+    auto index = t_pool == this ? t_index : 0;
+    while (pending.load() > 0) {
+      if (!try_run(index)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void work(uint32_t index) {
+    t_pool = this;
+    t_index = index;
+    for (;;) {
+      if (try_run(index)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this] { return quit || queued.load() > 0; });
+      if (quit) {
+        return;
+      }
+    }
+  }
+};
+
+thread_local const job_pool_impl *job_pool_impl::t_pool = nullptr;
+thread_local uint32_t job_pool_impl::t_index = 0;
+
+WorkStealingJobScheduler::WorkStealingJobScheduler(uint32_t threadCount) {
+  if (threadCount == 0) {
+    auto hardware = std::thread::hardware_concurrency();
+    threadCount = hardware > 1 ? hardware - 1 : 0;
+  }
+  m_impl = new job_pool_impl(threadCount);
+}
+
+WorkStealingJobScheduler::~WorkStealingJobScheduler() { delete m_impl; }
+
+uint32_t WorkStealingJobScheduler::thread_count() const {
+  return static_cast<uint32_t>(m_impl->threads.size());
+}
+
+void WorkStealingJobScheduler::submit(JobFunction function, void *context,
+                                      uint32_t begin, uint32_t end) {
+  m_impl->submit({function, context, begin, end});
+}
+
+void WorkStealingJobScheduler::wait() { m_impl->wait(); }
+
+} // namespace gizmesh
@@ -0,0 +1,182 @@
+#pragma once
+#include "gizmesh.h"
+#include <algorithm>
+#include <string.h>
+
+namespace gizmesh {
+
+///
+/// Byte layout of GizmoSystem::Format and the attribute encoders
+///
+struct vertex_layout {
+  GizmoSystem::Format format;
+  uint32_t stride = 0;
+  uint32_t positionOffset = ~0u;
+  uint32_t normalOffset = ~0u;
+  uint32_t colorOffset = ~0u;
+  uint32_t indexStride = 4;
+  // GizmoSystem::VertexEncoder. writes the vertices instead of format
+  void (*encode)(const GizmoSystem::VertexBlock &, uint8_t *) = nullptr;
+
+  vertex_layout(const GizmoSystem::Format &f = {}) : format(f) {
+    positionOffset = stride;
+    switch (f.position) {
+    case GizmoSystem::PositionFormat::Float3:
+      stride += 12;
+      break;
+    case GizmoSystem::PositionFormat::Half4:
+      stride += 8;
+      break;
+    }
+    if (f.normal != GizmoSystem::NormalFormat::None) {
+      normalOffset = stride;
+      stride += f.normal == GizmoSystem::NormalFormat::Float3 ? 12 : 4;
+    }
+    colorOffset = stride;
+    stride += f.color == GizmoSystem::ColorFormat::Float4 ? 16 : 4;
+    indexStride = f.index == GizmoSystem::IndexFormat::UInt16 ? 2 : 4;
+  }
+
+  // the vertices of encoder, only the index format of f applies
+  vertex_layout(const GizmoSystem::Format &f,
+                const GizmoSystem::VertexEncoder &encoder)
+      : vertex_layout(f) {
+    stride = encoder.stride;
+    positionOffset = ~0u;
+    normalOffset = ~0u;
+    colorOffset = ~0u;
+    encode = encoder.encode;
+  }
+
+  bool operator==(const vertex_layout &rhs) const {
+    return format.position == rhs.format.position &&
+           format.normal == rhs.format.normal &&
+           format.color == rhs.format.color &&
+           format.index == rhs.format.index && stride == rhs.stride &&
+           positionOffset == rhs.positionOffset &&
+           normalOffset == rhs.normalOffset &&
+           colorOffset == rhs.colorOffset && indexStride == rhs.indexStride &&
+           encode == rhs.encode;
+  }
+  bool operator!=(const vertex_layout &rhs) const { return !(*this == rhs); }
+
+  // world space normals are needed
+  bool has_normal() const { return encode || normalOffset != ~0u; }
+  // GizmoSystem::ColorFormat::Palette8 indices are needed
+  bool has_palette() const {
+    return !encode && format.color == GizmoSystem::ColorFormat::Palette8;
+  }
+
+  uint32_t max_vertices() const {
+    return format.index == GizmoSystem::IndexFormat::UInt16 ? 65536 : ~0u;
+  }
+};
+
+inline uint16_t float_to_half(float value) {
+  uint32_t f;
+  memcpy(&f, &value, 4);
+  uint32_t sign = (f >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((f >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = f & 0x7fffff;
+  if (exponent <= 0) {
+    // flush denormals to zero
+    return static_cast<uint16_t>(sign);
+  }
+  if (exponent >= 31) {
+    // inf or overflow
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+  // round to nearest
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000) {
+    ++half;
+  }
+  return static_cast<uint16_t>(half);
+}
+
+inline int8_t float_to_snorm8(float value) {
+  return static_cast<int8_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 127));
+}
+
+inline int16_t float_to_snorm16(float value) {
+  return static_cast<int16_t>(
+      std::round(std::clamp(value, -1.0f, 1.0f) * 32767));
+}
+
+inline uint8_t float_to_unorm8(float value) {
+  return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255));
+}
+
+inline void encode_position(GizmoSystem::PositionFormat format, uint8_t *dst,
+                            const falg::float3 &p) {
+  switch (format) {
+  case GizmoSystem::PositionFormat::Float3:
+    memcpy(dst, p.data(), 12);
+    break;
+  case GizmoSystem::PositionFormat::Half4: {
+    uint16_t h[4] = {float_to_half(p[0]), float_to_half(p[1]),
+                     float_to_half(p[2]), 0x3c00};
+    memcpy(dst, h, 8);
+    break;
+  }
+  }
+}
+
+inline void encode_normal(GizmoSystem::NormalFormat format, uint8_t *dst,
+                          const falg::float3 &n) {
+  switch (format) {
+  case GizmoSystem::NormalFormat::Float3:
+    memcpy(dst, n.data(), 12);
+    break;
+  case GizmoSystem::NormalFormat::Snorm8x4: {
+    int8_t s[4] = {float_to_snorm8(n[0]), float_to_snorm8(n[1]),
+                   float_to_snorm8(n[2]), 0};
+    memcpy(dst, s, 4);
+    break;
+  }
+  case GizmoSystem::NormalFormat::Oct16x2: {
+    // project to the octahedron, fold the lower hemisphere
+    auto l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+    if (l1 == 0) {
+      // the zero normal of a line vertex
+      l1 = 1;
+    }
+    auto x = n[0] / l1;
+    auto y = n[1] / l1;
+    if (n[2] < 0) {
+      auto fx = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+      auto fy = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+      x = fx;
+      y = fy;
+    }
+    int16_t s[2] = {float_to_snorm16(x), float_to_snorm16(y)};
+    memcpy(dst, s, 4);
+    break;
+  }
+  case GizmoSystem::NormalFormat::None:
+    break;
+  }
+}
+
+// color is the same for all vertices of a component. encode once and copy
+inline void encode_color(GizmoSystem::ColorFormat format, uint8_t *dst,
+                         const falg::float4 &c, uint32_t paletteIndex) {
+  switch (format) {
+  case GizmoSystem::ColorFormat::Float4:
+    memcpy(dst, c.data(), 16);
+    break;
+  case GizmoSystem::ColorFormat::Unorm8x4: {
+    uint8_t u[4] = {float_to_unorm8(c[0]), float_to_unorm8(c[1]),
+                    float_to_unorm8(c[2]), float_to_unorm8(c[3])};
+    memcpy(dst, u, 4);
+    break;
+  }
+  case GizmoSystem::ColorFormat::Palette8: {
+    uint8_t u[4] = {static_cast<uint8_t>(paletteIndex), 0, 0, 0};
+    memcpy(dst, u, 4);
+    break;
+  }
+  }
+}
+
+} // namespace gizmesh
@@ -0,0 +1,92 @@
+#include "vertex_kernel.h"
+
+namespace gizmesh {
+
+// falg selects the instruction set
+#ifdef FALG_SIMD
+using falg::simd;
+#endif
+
+// dst = x * src.x + (y * src.y + z * src.z) (+ t).
+// the order of falg::Affine, so the results are the same
+template <bool TRANSLATE>
+static void transform(const falg::Affine &m, const soa_float3 &src,
+                      size_t begin, size_t count, float *dstX, float *dstY,
+                      float *dstZ) {
+  auto sx = src.x.data() + begin;
+  auto sy = src.y.data() + begin;
+  auto sz = src.z.data() + begin;
+#ifdef FALG_SIMD
+  simd::type rows[3][3];
+  const falg::float3 *basis[] = {&m.x, &m.y, &m.z};
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      rows[r][c] = simd::set((*basis[r])[c]);
+    }
+  }
+  simd::type t[] = {simd::set(m.t[0]), simd::set(m.t[1]), simd::set(m.t[2])};
+  float *dst[] = {dstX, dstY, dstZ};
+  for (size_t i = 0; i < count; i += FALG_SIMD) {
+    auto x = simd::load(sx + i);
+    auto y = simd::load(sy + i);
+    auto z = simd::load(sz + i);
+    for (int c = 0; c < 3; ++c) {
+      auto v = simd::add(simd::mul(rows[0][c], x),
+                         simd::add(simd::mul(rows[1][c], y),
+                                   simd::mul(rows[2][c], z)));
+      if (TRANSLATE) {
+        v = simd::add(v, t[c]);
+      }
+      simd::store(dst[c] + i, v);
+    }
+  }
+#else
+  for (size_t i = 0; i < count; ++i) {
+    falg::float3 v{
+        m.x[0] * sx[i] + (m.y[0] * sy[i] + m.z[0] * sz[i]),
+        m.x[1] * sx[i] + (m.y[1] * sy[i] + m.z[1] * sz[i]),
+        m.x[2] * sx[i] + (m.y[2] * sy[i] + m.z[2] * sz[i]),
+    };
+    if (TRANSLATE) {
+      v = falg::Add(v, m.t);
+    }
+    dstX[i] = v[0];
+    dstY[i] = v[1];
+    dstZ[i] = v[2];
+  }
+#endif
+}
+
+void transform_positions(const falg::Affine &m, const soa_float3 &src,
+                         size_t begin, size_t count, float *dstX, float *dstY,
+                         float *dstZ) {
+  transform<true>(m, src, begin, count, dstX, dstY, dstZ);
+}
+
+void transform_positions(const falg::Translation &m, const soa_float3 &src,
+                         size_t begin, size_t count, float *dstX, float *dstY,
+                         float *dstZ) {
+  const float *srcs[] = {src.x.data() + begin, src.y.data() + begin,
+                         src.z.data() + begin};
+  float *dst[] = {dstX, dstY, dstZ};
+  for (int c = 0; c < 3; ++c) {
+#ifdef FALG_SIMD
+    auto t = simd::set(m.t[c]);
+    for (size_t i = 0; i < count; i += FALG_SIMD) {
+      simd::store(dst[c] + i, simd::add(simd::load(srcs[c] + i), t));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+      dst[c][i] = srcs[c][i] + m.t[c];
+    }
+#endif
+  }
+}
+
+void transform_directions(const falg::Affine &m, const soa_float3 &src,
+                          size_t begin, size_t count, float *dstX, float *dstY,
+                          float *dstZ) {
+  transform<false>(m, src, begin, count, dstX, dstY, dstZ);
+}
+
+} // namespace gizmesh
@@ -0,0 +1,58 @@
+#pragma once
+#include <falg.h>
+#include <vector>
+
+namespace gizmesh {
+
+// floats per instruction of the kernels. the SoA arrays are padded to it
+#ifdef FALG_SIMD
+const size_t soa_width = FALG_SIMD;
+#else
+const size_t soa_width = 4;
+#endif
+
+///
+/// float3 array split into one array per coordinate for the SIMD kernels.
+///
+/// The arrays are zero padded to a multiple of soa_width, count is the
+/// number of valid elements.
+///
+struct soa_float3 {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  size_t count = 0;
+
+  soa_float3() = default;
+  template <typename T, typename F> soa_float3(const T &values, F get) {
+    count = values.size();
+    auto padded = (count + soa_width - 1) / soa_width * soa_width;
+    x.resize(padded);
+    y.resize(padded);
+    z.resize(padded);
+    for (size_t i = 0; i < count; ++i) {
+      auto &v = get(values[i]);
+      x[i] = v[0];
+      y[i] = v[1];
+      z[i] = v[2];
+    }
+  }
+
+  size_t padded() const { return x.size(); }
+};
+
+// falg::Affine::ApplyPosition and ApplyDirection of
+// [begin, begin + count) of src into dst[0, count).
+// begin and count are multiples of soa_width
+void transform_positions(const falg::Affine &m, const soa_float3 &src,
+                         size_t begin, size_t count, float *dstX, float *dstY,
+                         float *dstZ);
+void transform_directions(const falg::Affine &m, const soa_float3 &src,
+                          size_t begin, size_t count, float *dstX, float *dstY,
+                          float *dstZ);
+// identity rotation. only the add. directions are unchanged, read src
+void transform_positions(const falg::Translation &m, const soa_float3 &src,
+                         size_t begin, size_t count, float *dstX, float *dstY,
+                         float *dstZ);
+
+} // namespace gizmesh